@@ -10,45 +10,46 @@
 int main(){
 
     Trie trie = Trie();
+    // read-only image of a saved trie; while open, queries are answered from it
+    // and commands that modify the trie fail
+    TrieImage image;
 
     auto load = [&trie]() {
         // load all words in corpus.txt into the trie
-        std::ifstream file("corpus.txt");
-        std::string word;
-        while (file >> word) {
-            trie.insert(word);
-        }
+        trie.bulkLoad("corpus.txt");
         std::cout << "success" << std::endl;
     };
 
-    auto insert = [&trie](const std::string& word) {
-        if(trie.insert(word)) {
+    auto insert = [&trie, &image](const std::string& word) {
+        if(!image.isOpen() && trie.insert(word)) {
             std::cout << "success" << std::endl;
         } else {
             std::cout << "failure" << std::endl;
         }
     };
 
-    auto numWords = [&trie](const std::string& word) {
+    auto numWords = [&trie, &image](const std::string& word) {
         try {
-            auto count = trie.numWords(word);
+            auto count = image.isOpen() ? image.numWords(word) : trie.numWords(word);
             std::cout << "count is " << count << std::endl;
         } catch (std::invalid_argument& e) {
             std::cout << "not found" << std::endl;
         }
     };
 
-    auto size = [&trie]() {
-        std::cout << "number of words is " << trie.numWords() << std::endl;
+    auto size = [&trie, &image]() {
+        auto count = image.isOpen() ? image.numWords() : trie.numWords();
+        std::cout << "number of words is " << count << std::endl;
     };
 
-    auto erase = [&trie](std::string word) {
-        bool deleted = trie.erase(word);
+    auto erase = [&trie, &image](std::string word) {
+        bool deleted = !image.isOpen() && trie.erase(word);
         std::cout << (deleted ? "success" : "failure") << std::endl;
     };
 
-    auto empty = [&trie]() {
-        std::cout << "empty " << (trie.empty() ? "1" : "0") << std::endl;
+    auto empty = [&trie, &image]() {
+        bool is_empty = image.isOpen() ? image.empty() : trie.empty();
+        std::cout << "empty " << (is_empty ? "1" : "0") << std::endl;
     };
 
     #ifdef TEST_MODE
@@ -57,7 +58,10 @@ int main(){
         std::cin >> command;
 
         if (command == "load") {
-            load();
+            if (image.isOpen())
+                std::cout << "failure" << std::endl;
+            else
+                load();
         } else if (command == "i") {
             std::string word;
             std::cin >> word;
@@ -73,15 +77,42 @@ int main(){
             erase(word);
 
         } else if (command == "p") {
-            trie.printTrie();
+            if (image.isOpen())
+                image.printTrie();
+            else
+                trie.printTrie();
         } else if (command == "spellcheck") {
             std::string word;
             std::cin >> word;
-            trie.spellcheck(word);
+            if (image.isOpen())
+                image.spellcheck(word);
+            else
+                trie.spellcheck(word);
         } else if (command == "empty") {
             empty();
         } else if (command == "clear") {
-            trie.clear();
+            if (image.isOpen())
+                std::cout << "failure" << std::endl;
+            else
+                trie.clear();
+        } else if (command == "save") {
+            std::string filename;
+            std::cin >> filename;
+            std::cout << (trie.save(filename) ? "success" : "failure") << std::endl;
+        } else if (command == "dawg") {
+            // minimize the current trie into a word graph and serve queries from it
+            if (image.isOpen() || !image.attach(trie.buildImage(true))) {
+                std::cout << "failure" << std::endl;
+            } else {
+                std::cout << "nodes " << trie.numNodes() << " -> " << image.numNodes() << std::endl;
+            }
+        } else if (command == "open") {
+            std::string filename;
+            std::cin >> filename;
+            std::cout << (image.open(filename) ? "success" : "failure") << std::endl;
+        } else if (command == "close") {
+            image.close();
+            std::cout << "success" << std::endl;
         } else if (command == "size")  {
             size();
         } else if (command == "exit")  {
@@ -1,67 +1,448 @@
 #include "trie.h"
+#include <algorithm>
+#include <cstring>
+#include <unordered_map>
+#include <fstream>
+#include <thread>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+/*
+MAPPEDFILE CLASS IMPLEMENTATION
+*/
+
+/**
+ * @brief Maps the file at filename into memory
+ * @param filename (std::string) - path of the file to map
+ * @return (bool) - false if the file could not be opened or mapped
+ */
+bool MappedFile::open(const std::string& filename) {
+    this->close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // mmap rejects empty mappings, an empty file is simply an empty range
+    if (st.st_size > 0) {
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+        this->_data = static_cast<const char*>(addr);
+        this->_size = st.st_size;
+    }
+    ::close(fd);
+    return true;
+}
+
+void MappedFile::close() {
+    if (this->_data != nullptr)
+        munmap(const_cast<char*>(this->_data), this->_size);
+    this->_data = nullptr;
+    this->_size = 0;
+}
+
+/*
+TRIENODE CLASS IMPLEMENTATION
+*/
+
+struct TrieNode::Node4 {
+    uint8_t keys[4]; // sorted
+    TrieNode* children[4];
+};
+
+struct TrieNode::Node16 {
+    uint8_t keys[16]; // sorted
+    TrieNode* children[16];
+};
+
+struct TrieNode::Node48 {
+    uint8_t index[256]; // slot + 1 of the child for each byte, 0 if absent
+    TrieNode* children[48]; // slots [0, _num_children) are in use
+};
+
+struct TrieNode::Node256 {
+    TrieNode* children[256];
+};
+
+namespace {
+
+/**
+ * @brief Position of key among the first count bytes of a 16-byte key array, or -1
+ * Compares all 16 keys at once with SSE2 when available.
+ */
+inline int findKey16(const uint8_t* keys, unsigned int count, uint8_t key) {
+#if defined(__SSE2__)
+    __m128i matches = _mm_cmpeq_epi8(_mm_set1_epi8(static_cast<char>(key)),
+                                     _mm_loadu_si128(reinterpret_cast<const __m128i*>(keys)));
+    int mask = _mm_movemask_epi8(matches) & ((1 << count) - 1);
+    return mask ? __builtin_ctz(mask) : -1;
+#else
+    for (unsigned int i = 0; i < count; i++) {
+        if (keys[i] == key)
+            return i;
+    }
+    return -1;
+#endif
+}
+
+/**
+ * @brief Inserts (key, child) into parallel sorted arrays holding count entries
+ */
+inline void insertSorted(uint8_t* keys, TrieNode** children, unsigned int count, uint8_t key, TrieNode* child) {
+    unsigned int pos = count;
+    while (pos > 0 && keys[pos-1] > key) {
+        keys[pos] = keys[pos-1];
+        children[pos] = children[pos-1];
+        pos--;
+    }
+    keys[pos] = key;
+    children[pos] = child;
+}
+
+/**
+ * @brief Removes entry i from parallel sorted arrays holding count entries
+ */
+inline void eraseSorted(uint8_t* keys, TrieNode** children, unsigned int count, unsigned int i) {
+    for (; i + 1 < count; i++) {
+        keys[i] = keys[i+1];
+        children[i] = children[i+1];
+    }
+}
+
+} // namespace
 
 /*
     * @brief Constructor for TrieNode object
-    * Initializes _is_last_char and the _children array to nullptrs
+    * Initializes _is_last_char, the node starts without a child block
     * @param last_char (bool) - whether the node is the last character of a word
 */
-TrieNode::TrieNode(bool last_char) {
-    _is_last_char = last_char;
-    for (int i = 0; i < 26; i++)
-        _children[i] = nullptr;
-}
+TrieNode::TrieNode(bool last_char)
+    : _children{nullptr}, _num_children{0}, _kind{NONE}, _is_last_char{last_char} {}
 
 /*
     * @brief Destructor for TrieNode object
-    * Recursively deletes all children of the node
+    * Deletes all descendants of the node using an explicit stack
 */
 TrieNode::~TrieNode() {
-    for (int i = 0; i < 26; i++) {
-        if (_children[i] != nullptr) {
-            delete _children[i];
+    if (!this->has_children()) {
+        this->_freeBlock();
+        return;
+    }
+
+    // Detach each node's children before deleting it, so every nested
+    // destructor call sees a leaf and returns right away
+    std::vector<TrieNode*> stack;
+    int key = -1;
+    while (TrieNode* child = this->nextChild(key))
+        stack.push_back(child);
+    this->releaseChildren();
+
+    while (!stack.empty()) {
+        TrieNode* node = stack.back();
+        stack.pop_back();
+        key = -1;
+        while (TrieNode* child = node->nextChild(key))
+            stack.push_back(child);
+        node->releaseChildren();
+        delete node;
+    }
+}
+
+void TrieNode::_freeBlock() {
+    switch (this->_kind) {
+        case NODE4: delete static_cast<Node4*>(this->_children); break;
+        case NODE16: delete static_cast<Node16*>(this->_children); break;
+        case NODE48: delete static_cast<Node48*>(this->_children); break;
+        case NODE256: delete static_cast<Node256*>(this->_children); break;
+        case NONE: break;
+    }
+    this->_children = nullptr;
+    this->_kind = NONE;
+}
+
+/**
+ * @brief Moves the children into a freshly allocated block of the given kind
+ */
+void TrieNode::_rebuild(Kind kind) {
+    uint8_t keys[256];
+    TrieNode* children[256];
+    unsigned int count = 0;
+    int key = -1;
+    while (TrieNode* child = this->nextChild(key)) {
+        keys[count] = key;
+        children[count++] = child;
+    }
+    this->_freeBlock();
+
+    this->_kind = kind;
+    switch (kind) {
+        case NODE4: {
+            Node4* block = new Node4();
+            std::copy(keys, keys + count, block->keys);
+            std::copy(children, children + count, block->children);
+            this->_children = block;
+            break;
+        }
+        case NODE16: {
+            Node16* block = new Node16();
+            std::copy(keys, keys + count, block->keys);
+            std::copy(children, children + count, block->children);
+            this->_children = block;
+            break;
         }
+        case NODE48: {
+            Node48* block = new Node48();
+            for (unsigned int i = 0; i < count; i++) {
+                block->index[keys[i]] = i + 1;
+                block->children[i] = children[i];
+            }
+            this->_children = block;
+            break;
+        }
+        case NODE256: {
+            Node256* block = new Node256();
+            for (unsigned int i = 0; i < count; i++)
+                block->children[keys[i]] = children[i];
+            this->_children = block;
+            break;
+        }
+        case NONE:
+            break;
     }
 }
 
-TrieNode*& TrieNode::getChild(char uppercaseLetter) {
+TrieNode* TrieNode::getChild(char key) const {
     /*
     Args:
-        uppercaseLetter (char) - the character path node to return
+        key (char) - the byte of the path node to return
     Returns:
-        node (Trienode*) - the address of the node down the character's path
-    return nullptr; // Placeholder to satisfy return type. Actual implementation is context-specific and not provided.
+        node (Trienode*) - the node down the byte's path, nullptr if there is none
     */
-    if (uppercaseLetter < 'A' || uppercaseLetter > 'Z')
-        throw std::invalid_argument("Character must be an uppercase ASCII letter.");
-
-    unsigned int index = uppercaseLetter - 0x41;
-    return this->_children[index];
+    const uint8_t k = static_cast<uint8_t>(key);
+    switch (this->_kind) {
+        case NODE4: {
+            const Node4* block = static_cast<const Node4*>(this->_children);
+            for (unsigned int i = 0; i < this->_num_children; i++) {
+                if (block->keys[i] == k)
+                    return block->children[i];
+            }
+            return nullptr;
+        }
+        case NODE16: {
+            const Node16* block = static_cast<const Node16*>(this->_children);
+            int i = findKey16(block->keys, this->_num_children, k);
+            return i < 0 ? nullptr : block->children[i];
+        }
+        case NODE48: {
+            const Node48* block = static_cast<const Node48*>(this->_children);
+            uint8_t slot = block->index[k];
+            return slot == 0 ? nullptr : block->children[slot - 1];
+        }
+        case NODE256:
+            return static_cast<const Node256*>(this->_children)->children[k];
+        case NONE:
+            break;
+    }
+    return nullptr;
 }
 
-TrieNode*& TrieNode::operator[](char uppercaseLetter) {
+TrieNode* TrieNode::operator[](char key) const {
     // Alias for getChild
-    return this->getChild(uppercaseLetter);
+    return this->getChild(key);
 }
 
 /**
  * @brief Sets a child for the current node
- * @param uppercaseLetter (char) - The uppercase letter for which to set the child node.
+ * @param key (char) - The byte for which to set the child node.
  * @param last_char (bool) - Indicates whether the new child node is the last character of a word.
+ * @return (TrieNode*) - the new child
  */
-TrieNode* TrieNode::setChild(char uppercaseLetter, bool last_char) {
-    if (uppercaseLetter < 'A' || uppercaseLetter > 'Z')
-        throw std::invalid_argument("Character must be an uppercase ASCII letter.");
+TrieNode* TrieNode::setChild(char key, bool last_char) {
+    TrieNode* child = new TrieNode(last_char);
+    this->adoptChild(key, child);
+    return child;
+}
 
-    unsigned int index = uppercaseLetter - 0x41;
-    this->_children[index] = new TrieNode(last_char);
+/**
+ * @brief Links an existing node as the child under key, which must not have a child yet
+ */
+void TrieNode::adoptChild(char key, TrieNode* child) {
+    const uint8_t k = static_cast<uint8_t>(key);
+
+    // Move up one tier when the current block is full
+    switch (this->_kind) {
+        case NONE: this->_rebuild(NODE4); break;
+        case NODE4: if (this->_num_children == 4) this->_rebuild(NODE16); break;
+        case NODE16: if (this->_num_children == 16) this->_rebuild(NODE48); break;
+        case NODE48: if (this->_num_children == 48) this->_rebuild(NODE256); break;
+        case NODE256: break;
+    }
 
-    return this->_children[index];
+    switch (this->_kind) {
+        case NODE4: {
+            Node4* block = static_cast<Node4*>(this->_children);
+            insertSorted(block->keys, block->children, this->_num_children, k, child);
+            break;
+        }
+        case NODE16: {
+            Node16* block = static_cast<Node16*>(this->_children);
+            insertSorted(block->keys, block->children, this->_num_children, k, child);
+            break;
+        }
+        case NODE48: {
+            Node48* block = static_cast<Node48*>(this->_children);
+            block->children[this->_num_children] = child;
+            block->index[k] = this->_num_children + 1;
+            break;
+        }
+        case NODE256:
+            static_cast<Node256*>(this->_children)->children[k] = child;
+            break;
+        case NONE:
+            break;
+    }
+    this->_num_children++;
 }
 
+/**
+ * @brief Unlinks the child under key without deleting it, shrinking the block if it got sparse
+ */
+void TrieNode::setChildNull(char key) {
+    const uint8_t k = static_cast<uint8_t>(key);
+    switch (this->_kind) {
+        case NODE4: {
+            Node4* block = static_cast<Node4*>(this->_children);
+            unsigned int i = 0;
+            while (i < this->_num_children && block->keys[i] != k)
+                i++;
+            if (i == this->_num_children)
+                return;
+            eraseSorted(block->keys, block->children, this->_num_children, i);
+            break;
+        }
+        case NODE16: {
+            Node16* block = static_cast<Node16*>(this->_children);
+            int i = findKey16(block->keys, this->_num_children, k);
+            if (i < 0)
+                return;
+            eraseSorted(block->keys, block->children, this->_num_children, i);
+            break;
+        }
+        case NODE48: {
+            Node48* block = static_cast<Node48*>(this->_children);
+            uint8_t slot = block->index[k];
+            if (slot == 0)
+                return;
+            // keep the used slots contiguous by moving the last one into the hole
+            uint8_t last = this->_num_children;
+            if (slot != last) {
+                block->children[slot - 1] = block->children[last - 1];
+                for (unsigned int b = 0; b < 256; b++) {
+                    if (block->index[b] == last) {
+                        block->index[b] = slot;
+                        break;
+                    }
+                }
+            }
+            block->index[k] = 0;
+            break;
+        }
+        case NODE256: {
+            Node256* block = static_cast<Node256*>(this->_children);
+            if (block->children[k] == nullptr)
+                return;
+            block->children[k] = nullptr;
+            break;
+        }
+        case NONE:
+            return;
+    }
+    this->_num_children--;
+
+    // Move down a tier with some slack, so alternating insert/erase does not thrash
+    if (this->_num_children == 0)
+        this->_freeBlock();
+    else if (this->_kind == NODE16 && this->_num_children <= 3)
+        this->_rebuild(NODE4);
+    else if (this->_kind == NODE48 && this->_num_children <= 12)
+        this->_rebuild(NODE16);
+    else if (this->_kind == NODE256 && this->_num_children <= 40)
+        this->_rebuild(NODE48);
+}
+
+/**
+ * @brief Unlinks all children without deleting them and frees the child block
+ */
+void TrieNode::releaseChildren() {
+    this->_freeBlock();
+    this->_num_children = 0;
+}
 
-void TrieNode::setChildNull(char uppercaseLetter) {
-    unsigned int index = uppercaseLetter - 0x41;
-    this->_children[index] = nullptr;
+/**
+ * @brief Finds the child with the smallest byte greater than key
+ * @param key (int) - previous byte, updated to the byte of the returned child
+ * @return (TrieNode*) - the next child, or nullptr once all children were visited
+ */
+TrieNode* TrieNode::nextChild(int& key) const {
+    switch (this->_kind) {
+        case NODE4: {
+            const Node4* block = static_cast<const Node4*>(this->_children);
+            for (unsigned int i = 0; i < this->_num_children; i++) {
+                if (block->keys[i] > key) {
+                    key = block->keys[i];
+                    return block->children[i];
+                }
+            }
+            return nullptr;
+        }
+        case NODE16: {
+            const Node16* block = static_cast<const Node16*>(this->_children);
+            for (unsigned int i = 0; i < this->_num_children; i++) {
+                if (block->keys[i] > key) {
+                    key = block->keys[i];
+                    return block->children[i];
+                }
+            }
+            return nullptr;
+        }
+        case NODE48: {
+            const Node48* block = static_cast<const Node48*>(this->_children);
+            for (int k = key + 1; k < 256; k++) {
+                if (block->index[k] != 0) {
+                    key = k;
+                    return block->children[block->index[k] - 1];
+                }
+            }
+            return nullptr;
+        }
+        case NODE256: {
+            const Node256* block = static_cast<const Node256*>(this->_children);
+            for (int k = key + 1; k < 256; k++) {
+                if (block->children[k] != nullptr) {
+                    key = k;
+                    return block->children[k];
+                }
+            }
+            return nullptr;
+        }
+        case NONE:
+            break;
+    }
+    return nullptr;
 }
 
 bool TrieNode::isLastChar() {
@@ -73,12 +454,41 @@ void TrieNode::setLastChar(bool last_char) {
 }
 
 bool TrieNode::has_children() { 
-    for (int i = 0; i < 26; i++) {
-        if (_children[i] != nullptr) {
-            return true;
+    return this->_num_children > 0;
+}
+
+/*
+TRIEWORDS CLASS IMPLEMENTATION
+*/
+
+TrieWords::iterator::iterator(TrieNode* start, const std::string& prefix) : _word{prefix} {
+    if (start != nullptr) {
+        this->_stack.push_back({start, -1});
+        this->_advance();
+    }
+}
+
+/**
+ * @brief Moves to the next node marked as the end of a word, or empties the stack
+ */
+void TrieWords::iterator::_advance() {
+    while (!this->_stack.empty()) {
+        Frame& frame = this->_stack.back();
+        TrieNode* child = frame.node->nextChild(frame.key);
+
+        if (child == nullptr) {
+            // every child of this node is done, step back up
+            this->_stack.pop_back();
+            if (!this->_stack.empty())
+                this->_word.pop_back();
+            continue;
         }
+
+        this->_word.push_back(static_cast<char>(frame.key));
+        this->_stack.push_back({child, -1});
+        if (child->isLastChar())
+            return;
     }
-    return false;
 }
 
 /*
@@ -130,15 +540,162 @@ bool Trie::insert(const std::string& word) {
     return true;
 }
 
-bool Trie::erase(std::string& word) {
-    TrieNode*& first_char_pointer = this->_root->getChild(word[0]);
-    bool deleted = eraseRecursive(word, first_char_pointer);
-    if (deleted)
-        this->num_words--;
-    return deleted;
+/**
+ * @brief Inserts the characters word[0..len) below start
+ * @return (bool) - false if the word was already stored below start
+ */
+bool Trie::_insertAt(TrieNode* start, const char* word, std::size_t len) {
+    TrieNode* curr = start;
+    for (std::size_t i = 0; i < len; i++) {
+        TrieNode* child = curr->getChild(word[i]);
+        curr = (child == nullptr) ? curr->setChild(word[i]) : child;
+    }
+    if (curr->isLastChar())
+        return false;
+    curr->setLastChar(true);
+    return true;
 }
 
-bool Trie::eraseRecursive(std::string& word, TrieNode*& curr_node, int i) {
+/**
+ * @brief Moves every word stored below src into dst and deletes src
+ * @return (unsigned int) - number of words that were not already stored below dst
+ */
+unsigned int Trie::_merge(TrieNode* dst, TrieNode* src) {
+    unsigned int added = 0;
+    std::vector<std::pair<TrieNode*, TrieNode*>> stack;
+    stack.push_back({dst, src});
+
+    while (!stack.empty()) {
+        TrieNode* d = stack.back().first;
+        TrieNode* s = stack.back().second;
+        stack.pop_back();
+
+        if (s->isLastChar() && !d->isLastChar()) {
+            d->setLastChar(true);
+            added++;
+        }
+        int key = -1;
+        while (TrieNode* s_child = s->nextChild(key)) {
+            TrieNode* d_child = d->getChild(key);
+            if (d_child == nullptr) {
+                // whole branch is new, relink it instead of copying
+                d->adoptChild(key, s_child);
+                added += numWordsBelow(s_child, s_child->isLastChar());
+            } else {
+                stack.push_back({d_child, s_child});
+            }
+        }
+        s->releaseChildren();
+        delete s; // all children were relinked or queued above
+    }
+    return added;
+}
+
+/**
+ * @brief Inserts every whitespace-separated word of a file into the Trie
+ * @param filename (std::string) - path of the file to load
+ * @param num_threads (unsigned int) - worker count, 0 picks the hardware concurrency
+ * @return (bool) - false if the file could not be opened
+ */
+bool Trie::bulkLoad(const std::string& filename, unsigned int num_threads) {
+    MappedFile file;
+    if (!file.open(filename))
+        return false;
+
+    const char* data = file.data();
+    const std::size_t size = file.size();
+
+    if (num_threads == 0)
+        num_threads = std::thread::hardware_concurrency();
+    if (num_threads == 0)
+        num_threads = 1;
+    // no point in chunks smaller than a page
+    if (num_threads > size / 4096 + 1)
+        num_threads = size / 4096 + 1;
+
+    auto is_space = [](char c) {
+        return c == ' ' || c == '\n' || c == '\t' || c == '\r' || c == '\v' || c == '\f';
+    };
+
+    // Cut the file into chunks that start and end on whitespace
+    std::vector<std::size_t> bounds(num_threads + 1, size);
+    bounds[0] = 0;
+    for (unsigned int t = 1; t < num_threads; t++) {
+        std::size_t pos = std::max(size / num_threads * t, bounds[t-1]);
+        while (pos < size && !is_space(data[pos]))
+            pos++;
+        bounds[t] = pos;
+    }
+
+    // Phase 1: tokenize each chunk into buckets by first byte
+    struct WordRef {
+        const char* str;
+        std::size_t len;
+    };
+    std::vector<std::vector<std::vector<WordRef>>> buckets(num_threads, std::vector<std::vector<WordRef>>(256));
+    std::vector<std::thread> workers;
+
+    for (unsigned int t = 0; t < num_threads; t++) {
+        workers.emplace_back([&, t]() {
+            std::size_t i = bounds[t];
+            const std::size_t end = bounds[t+1];
+            while (i < end) {
+                while (i < end && is_space(data[i]))
+                    i++;
+                std::size_t start = i;
+                while (i < end && !is_space(data[i]))
+                    i++;
+                if (i > start)
+                    buckets[t][static_cast<uint8_t>(data[start])].push_back({data + start, i - start});
+            }
+        });
+    }
+    for (auto& w : workers)
+        w.join();
+    workers.clear();
+
+    // Phase 2: build one subtrie per first byte, chunks in file order
+    std::vector<TrieNode*> subtries(256, nullptr);
+    for (unsigned int t = 0; t < num_threads; t++) {
+        workers.emplace_back([&, t]() {
+            for (unsigned int letter = t; letter < 256; letter += num_threads) {
+                TrieNode* sub = nullptr;
+                for (unsigned int chunk = 0; chunk < num_threads; chunk++) {
+                    for (const WordRef& w : buckets[chunk][letter]) {
+                        if (sub == nullptr)
+                            sub = new TrieNode();
+                        _insertAt(sub, w.str + 1, w.len - 1);
+                    }
+                }
+                subtries[letter] = sub;
+            }
+        });
+    }
+    for (auto& w : workers)
+        w.join();
+
+    // Phase 3: splice the subtries under the root
+    for (unsigned int letter = 0; letter < 256; letter++) {
+        TrieNode* sub = subtries[letter];
+        if (sub == nullptr)
+            continue;
+        TrieNode* child = this->_root->getChild(letter);
+        if (child == nullptr) {
+            this->_root->adoptChild(letter, sub);
+            this->num_words += numWordsBelow(sub, sub->isLastChar());
+        } else {
+            this->num_words += _merge(child, sub);
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Erases a word from the Trie
+ * @param word (std::string) - The word to erase.
+ * @return (bool) - true if the word's path was found and unmarked, false otherwise.
+ */
+bool Trie::erase(std::string& word) {
     /* Case 1: Node to be deleted is a leaf node with no children
         -> Mark the node to be deleted as not an end of word anymore
         -> Delete the node
@@ -146,53 +703,69 @@ bool Trie::eraseRecursive(std::string& word, TrieNode*& curr_node, int i) {
     Case 2: Node to be deleted is not a leaf node
         -> Mark the node to be deleted as not an end of word anymore
     */
-    // get parent of node to be deleted
-    if (curr_node == nullptr)
-        return false;
+    // path[i] is the node reached after i characters, path[0] is the root
+    std::vector<TrieNode*> path{this->_root};
 
-    if ( i == (word.length() - 1) ) {
-        curr_node->setLastChar(false);
-        if (!curr_node->has_children()) {
-            delete curr_node;
-            curr_node = nullptr;
+    bool deleted = false;
+    while (path.size() <= word.length()) {
+        TrieNode* curr_node = path.back()->getChild(word[path.size() - 1]);
+        if (curr_node == nullptr)
+            break;
+        path.push_back(curr_node);
+        if (path.size() - 1 == word.length()) {
+            curr_node->setLastChar(false);
+            if (!curr_node->has_children()) {
+                path[path.size() - 2]->setChildNull(word[path.size() - 2]);
+                delete curr_node;
+            }
+            path.pop_back(); // the word's own node is not pruned below
+            deleted = true;
+            break;
         }
-        return true;
-    } else {
-        TrieNode*& child_of_next_char = curr_node->getChild(word[i+1]);
-        bool deleted = eraseRecursive(word, child_of_next_char, i+1);
+    }
 
+    // Prune ancestors that no longer lead to any word, deepest first
+    while (path.size() > 1) {
+        TrieNode* curr_node = path.back();
+        path.pop_back();
         if (!curr_node->has_children() && !curr_node->isLastChar()) {
+            path.back()->setChildNull(word[path.size() - 1]);
             delete curr_node;
-            curr_node = nullptr;
-        }   
-        return deleted;
+        }
     }
+
+    if (deleted)
+        this->num_words--;
+    return deleted;
 }
 
+/**
+ * @brief Prints all words in alphabetical order on a single line
+ */
 void Trie::printTrie() {
     // print all words in the Trie in alphabetical order on a single line. 
     // No output if the Trie is empty.
-    std::string word = "";
-    bool printed = false;
-    printTrieRecursive(this->_root, word, printed);
-    if (printed)
-        std::cout << std::endl;
+    std::string out;
+    for (const std::string& word : this->words()) {
+        out.append(word);
+        out.push_back(' ');
+    }
+    if (!out.empty()) {
+        out.push_back('\n');
+        std::cout.write(out.data(), out.size());
+        std::cout.flush();
+    }
 }
 
-void Trie::printTrieRecursive(TrieNode* root, std::string& word, bool& printed) {
-    for (unsigned char i = 'A'; i <= 'Z'; i++) {
-        const auto child_ptr = root->getChild(i);
-        if (child_ptr != nullptr) {
-            word.push_back(i);
-            if (child_ptr->isLastChar()) {
-                std::cout << word << " ";
-                printed = true;
-            }
-            printTrieRecursive(child_ptr, word, printed);
-            word.pop_back();
-        }
-    }
+/**
+ * @brief Lists every word of the Trie that starts with prefix
+ * @param prefix (std::string) - prefix of the listed words; only words strictly longer are listed
+ * @return (TrieWords) - an empty range if the prefix is not in the Trie
+ */
+TrieWords Trie::words(const std::string& prefix) {
+    return TrieWords(this->_findNode(prefix), prefix);
 }
+
 /**
  * @brief Counts the total number of words stored in the Trie.
  * @return (unsigned int) - The total number of words in the Trie.
@@ -214,7 +787,7 @@ unsigned int Trie::numWords(std::string prefix) {
         throw std::invalid_argument("not found");
     }
 
-    return numWordsRecursive(prefix_ptr, prefix_ptr->isLastChar());
+    return numWordsBelow(prefix_ptr, prefix_ptr->isLastChar());
 }
 
 void Trie::spellcheck(const std::string& word) {
@@ -229,14 +802,20 @@ void Trie::spellcheck(const std::string& word) {
     }
 
     for (int i{0}; i < word.length(); i++) {
-        TrieNode*& child_ptr = node->getChild(word[i]);
+        TrieNode* child_ptr = node->getChild(word[i]);
 
         if (child_ptr == nullptr || (i == (word.length()-1) && !child_ptr->isLastChar()) ){
             std::string common_prefix = child_ptr ? word : word.substr(0, i); // word[:i]
-            bool printed = false;
-            if (node->isLastChar())
-                std::cout << common_prefix << " ";
-            this->printTrieRecursive(child_ptr ? child_ptr : node, common_prefix, printed);
+            std::string out;
+            if (node->isLastChar()) {
+                out.append(common_prefix);
+                out.push_back(' ');
+            }
+            for (const std::string& suggestion : TrieWords(child_ptr ? child_ptr : node, common_prefix)) {
+                out.append(suggestion);
+                out.push_back(' ');
+            }
+            std::cout << out;
             break;
         }
         else if ( (i == (word.length()-1) ) && child_ptr->isLastChar() ) {
@@ -253,36 +832,369 @@ void Trie::spellcheck(const std::string& word) {
 }
 
 /**
- * @brief Recursively counts the number of words in the Trie.
- * @param root (TrieNode*) - The current node from which to count words.
- * @param numWords (unsigned int) - The current count of words. Defaults to 0 for the initial call.
- * @return (unsigned int) - The total number of words found from the current node downwards.
+ * @brief Counts the number of words below a node of the Trie.
+ * @param root (TrieNode*) - The node below which to count words.
+ * @param numWords (unsigned int) - Count to add to. Defaults to 0.
+ * @return (unsigned int) - numWords plus the words found strictly below root.
  */
-unsigned int Trie::numWordsRecursive(TrieNode* root, unsigned int numWords) {
-    // We want to add the number of words in each branch
-    for (unsigned char i = 'A'; i <= 'Z'; i++) {
-        const auto child_ptr = root->getChild(i);
-        if (child_ptr != nullptr) {
+unsigned int Trie::numWordsBelow(TrieNode* root, unsigned int numWords) {
+    std::vector<TrieNode*> stack{root};
+    while (!stack.empty()) {
+        TrieNode* node = stack.back();
+        stack.pop_back();
+        int key = -1;
+        while (TrieNode* child_ptr = node->nextChild(key)) {
             numWords += child_ptr->isLastChar(); // Increment if this node marks the end of a word
-            numWords = numWordsRecursive(child_ptr, numWords); // Recurse into the child node
+            stack.push_back(child_ptr);
         }
     }
     return numWords;
 }
 
 void Trie::clear() {
-    // keep root node, delete all children recursively
-    for (unsigned char i = 'A'; i <= 'Z'; i++) {
-        TrieNode*& child_ptr = this->_root->getChild(i);
-        if (child_ptr != nullptr) {
-            delete child_ptr;
-            child_ptr = nullptr;
-        }
-    }
+    // keep root node, delete all children
+    int key = -1;
+    while (TrieNode* child_ptr = this->_root->nextChild(key))
+        delete child_ptr;
+    this->_root->releaseChildren();
     this->num_words = 0;
     std::cout << "success" << std::endl;
 }
 
 bool Trie::empty() {
     return !this->_root->has_children();
-}
\ No newline at end of file
+}
+/**
+ * @brief Serializes the Trie into a flat, pointer-free TrieImage buffer
+ * @param minimize (bool) - whether to merge equivalent subtries
+ * @return (std::vector<char>) - header, node array and edge array back to back
+ */
+std::vector<char> Trie::buildImage(bool minimize) {
+    std::vector<TrieImageNode> nodes;
+    std::vector<TrieImageEdge> edges;
+
+    if (!minimize) {
+        // Breadth-first numbering: children of a node always get larger ids than the node
+        std::vector<TrieNode*> order{this->_root};
+
+        for (std::size_t i = 0; i < order.size(); i++) {
+            TrieNode* node = order[i];
+            TrieImageNode rec = {};
+            rec.first_edge = edges.size();
+            rec.is_last = node->isLastChar();
+            int key = -1;
+            while (TrieNode* child = node->nextChild(key)) {
+                TrieImageEdge edge = {};
+                edge.target = order.size();
+                edge.label = key;
+                edges.push_back(edge);
+                order.push_back(child);
+            }
+            rec.num_edges = edges.size() - rec.first_edge;
+            nodes.push_back(rec);
+        }
+
+        // Walking the ids backwards visits every child before its parent
+        for (std::size_t i = nodes.size(); i-- > 0;) {
+            nodes[i].num_words = nodes[i].is_last;
+            for (uint32_t e = 0; e < nodes[i].num_edges; e++)
+                nodes[i].num_words += nodes[edges[nodes[i].first_edge + e].target].num_words;
+        }
+    } else {
+        // Post-order walk: a node is finished once all of its children have canonical ids.
+        // The signature of a node is its end-of-word flag followed by (label, child id)
+        // pairs, so two nodes with equal signatures accept exactly the same suffixes.
+        struct Frame {
+            TrieNode* node;
+            int key; // byte of the last child visited, -1 before the first
+            std::vector<std::pair<char, uint32_t>> children;
+        };
+        std::unordered_map<std::string, uint32_t> canonical;
+        std::vector<Frame> stack;
+        stack.push_back({this->_root, -1, {}});
+        uint32_t finished_id = 0;
+
+        while (!stack.empty()) {
+            Frame& frame = stack.back();
+            TrieNode* next_child = frame.node->nextChild(frame.key);
+            if (next_child != nullptr) {
+                stack.push_back({next_child, -1, {}});
+                continue;
+            }
+
+            std::string signature(1, frame.node->isLastChar() ? '1' : '0');
+            for (const auto& child : frame.children) {
+                signature.push_back(child.first);
+                signature.append(reinterpret_cast<const char*>(&child.second), sizeof(uint32_t));
+            }
+
+            auto found = canonical.find(signature);
+            if (found != canonical.end()) {
+                finished_id = found->second;
+            } else {
+                TrieImageNode rec = {};
+                rec.first_edge = edges.size();
+                rec.num_edges = frame.children.size();
+                rec.is_last = frame.node->isLastChar();
+                rec.num_words = rec.is_last;
+                for (const auto& child : frame.children) {
+                    TrieImageEdge edge = {};
+                    edge.target = child.second;
+                    edge.label = child.first;
+                    edges.push_back(edge);
+                    rec.num_words += nodes[child.second].num_words;
+                }
+                finished_id = nodes.size();
+                nodes.push_back(rec);
+                canonical.emplace(signature, finished_id);
+            }
+
+            stack.pop_back();
+            if (!stack.empty()) {
+                // the finished node is the child the parent visited last
+                Frame& parent = stack.back();
+                parent.children.push_back({static_cast<char>(parent.key), finished_id});
+            }
+        }
+
+        // Children were numbered before their parents, flip the ids so the root is node 0
+        const uint32_t last = nodes.size() - 1;
+        std::reverse(nodes.begin(), nodes.end());
+        for (auto& edge : edges)
+            edge.target = last - edge.target;
+    }
+
+    TrieImageHeader header = {};
+    std::copy(TrieImage::MAGIC, TrieImage::MAGIC + 8, header.magic);
+    header.version = TrieImage::VERSION;
+    header.num_nodes = nodes.size();
+    header.num_edges = edges.size();
+    header.num_words = this->num_words;
+
+    std::vector<char> buffer(sizeof(header) + nodes.size() * sizeof(TrieImageNode) + edges.size() * sizeof(TrieImageEdge));
+    char* out = buffer.data();
+    std::memcpy(out, &header, sizeof(header));
+    out += sizeof(header);
+    std::memcpy(out, nodes.data(), nodes.size() * sizeof(TrieImageNode));
+    out += nodes.size() * sizeof(TrieImageNode);
+    std::memcpy(out, edges.data(), edges.size() * sizeof(TrieImageEdge));
+    return buffer;
+}
+
+/**
+ * @brief Writes buildImage(minimize) to a file
+ * @param filename (std::string) - path of the image to write
+ * @param minimize (bool) - whether to write the minimized word graph
+ * @return (bool) - false if the file could not be written
+ */
+bool Trie::save(const std::string& filename, bool minimize) {
+    std::vector<char> buffer = this->buildImage(minimize);
+    std::ofstream out(filename.c_str(), std::ios::binary | std::ios::trunc);
+    out.write(buffer.data(), buffer.size());
+    return out.good();
+}
+
+/**
+ * @brief Counts the nodes of the Trie, including the root
+ */
+unsigned int Trie::numNodes() {
+    unsigned int count = 0;
+    std::vector<TrieNode*> stack{this->_root};
+    while (!stack.empty()) {
+        TrieNode* node = stack.back();
+        stack.pop_back();
+        count++;
+        int key = -1;
+        while (TrieNode* child = node->nextChild(key))
+            stack.push_back(child);
+    }
+    return count;
+}
+
+/*
+TRIEIMAGE CLASS IMPLEMENTATION
+*/
+
+const char TrieImage::MAGIC[8] = {'T', 'R', 'I', 'E', 'I', 'M', 'G', '\0'};
+
+/**
+ * @brief Maps an image written by Trie::save
+ * @param filename (std::string) - path of the image
+ * @return (bool) - false if the file is missing, truncated, corrupted or not a TrieImage
+ */
+bool TrieImage::open(const std::string& filename) {
+    this->close();
+    if (!this->_file.open(filename))
+        return false;
+    if (!this->_bind(this->_file.data(), this->_file.size())) {
+        this->_file.close();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Serves an image built in memory, e.g. by Trie::buildImage(true)
+ * @param buffer (std::vector<char>) - image bytes, taken over by the TrieImage
+ * @return (bool) - false if the buffer is not a valid TrieImage
+ */
+bool TrieImage::attach(std::vector<char>&& buffer) {
+    this->close();
+    this->_buffer = std::move(buffer);
+    if (!this->_bind(this->_buffer.data(), this->_buffer.size())) {
+        this->_buffer.clear();
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief Validates an image and points the arrays into it. Every edge range and edge
+ * target is checked once here, so queries can follow them without bounds checks.
+ */
+bool TrieImage::_bind(const char* data, std::size_t size) {
+    if (size < sizeof(TrieImageHeader))
+        return false;
+
+    const TrieImageHeader* header = reinterpret_cast<const TrieImageHeader*>(data);
+    const std::size_t expected = sizeof(TrieImageHeader)
+        + std::size_t(header->num_nodes) * sizeof(TrieImageNode)
+        + std::size_t(header->num_edges) * sizeof(TrieImageEdge);
+    if (!std::equal(MAGIC, MAGIC + 8, header->magic) || header->version != VERSION
+            || header->num_nodes == 0 || size != expected)
+        return false;
+
+    const TrieImageNode* nodes = reinterpret_cast<const TrieImageNode*>(data + sizeof(TrieImageHeader));
+    const TrieImageEdge* edges = reinterpret_cast<const TrieImageEdge*>(nodes + header->num_nodes);
+    for (uint32_t i = 0; i < header->num_nodes; i++) {
+        if (uint64_t(nodes[i].first_edge) + nodes[i].num_edges > header->num_edges)
+            return false;
+    }
+    for (uint32_t e = 0; e < header->num_edges; e++) {
+        if (edges[e].target >= header->num_nodes)
+            return false;
+    }
+
+    this->_header = header;
+    this->_nodes = nodes;
+    this->_edges = edges;
+    return true;
+}
+
+void TrieImage::close() {
+    this->_file.close();
+    this->_buffer.clear();
+    this->_header = nullptr;
+    this->_nodes = nullptr;
+    this->_edges = nullptr;
+}
+
+/**
+ * @brief Returns the child of node along label, or -1 if there is none
+ */
+int64_t TrieImage::_child(uint32_t node, char label) const {
+    const TrieImageNode& n = this->_nodes[node];
+    const TrieImageEdge* first = this->_edges + n.first_edge;
+    const TrieImageEdge* last = first + n.num_edges;
+    const uint8_t key = static_cast<uint8_t>(label);
+    // edges are sorted by label, and a node may have up to 256 of them
+    const TrieImageEdge* e = std::lower_bound(first, last, key,
+        [](const TrieImageEdge& edge, uint8_t k) { return edge.label < k; });
+    return (e != last && e->label == key) ? static_cast<int64_t>(e->target) : -1;
+}
+
+/**
+ * @brief Appends "word " to out for every word strictly below node, in alphabetical order
+ * @param word (std::string) - characters on the path to node, restored before returning
+ */
+void TrieImage::_printBelow(uint32_t node, std::string& word, std::string& out) const {
+    struct Frame {
+        uint32_t node;
+        uint32_t next_edge;
+    };
+    std::vector<Frame> stack{{node, 0}};
+
+    while (!stack.empty()) {
+        Frame& frame = stack.back();
+        const TrieImageNode& n = this->_nodes[frame.node];
+        if (frame.next_edge == n.num_edges) {
+            stack.pop_back();
+            if (!stack.empty())
+                word.pop_back();
+            continue;
+        }
+        const TrieImageEdge& e = this->_edges[n.first_edge + frame.next_edge++];
+        word.push_back(e.label);
+        if (this->_nodes[e.target].is_last) {
+            out.append(word);
+            out.push_back(' ');
+        }
+        stack.push_back({e.target, 0});
+    }
+}
+
+void TrieImage::printTrie() const {
+    std::string word, out;
+    this->_printBelow(0, word, out);
+    if (!out.empty())
+        std::cout << out << std::endl;
+}
+
+unsigned int TrieImage::numWords() const {
+    return this->_header->num_words;
+}
+
+/**
+ * @brief Counts the words that start with prefix, read from the node's stored count
+ * @throws std::invalid_argument if the prefix is not found
+ */
+unsigned int TrieImage::numWords(const std::string& prefix) const {
+    int64_t node = 0;
+    for (std::size_t i = 0; i < prefix.length() && node >= 0; i++)
+        node = this->_child(node, prefix[i]);
+
+    if (node < 0)
+        throw std::invalid_argument("not found");
+    return this->_nodes[node].num_words;
+}
+
+void TrieImage::spellcheck(const std::string& word) const {
+    // Mirrors Trie::spellcheck so both backends print identical suggestions
+    if (this->_child(0, word[0]) < 0) {
+        std::cout << std::endl;
+        return;
+    }
+
+    uint32_t node = 0;
+    for (std::size_t i = 0; i < word.length(); i++) {
+        int64_t child = this->_child(node, word[i]);
+        bool last = (i == word.length() - 1);
+
+        if (child < 0 || (last && !this->_nodes[child].is_last)) {
+            std::string common_prefix = (child >= 0) ? word : word.substr(0, i);
+            std::string out;
+            if (this->_nodes[node].is_last) {
+                out.append(common_prefix);
+                out.push_back(' ');
+            }
+            this->_printBelow(child >= 0 ? child : node, common_prefix, out);
+            std::cout << out;
+            break;
+        } else if (last) {
+            std::cout << "correct";
+            break;
+        } else {
+            node = child;
+        }
+    }
+
+    std::cout << std::endl;
+}
+
+bool TrieImage::empty() const {
+    return this->_nodes[0].num_edges == 0;
+}
+
+unsigned int TrieImage::numNodes() const {
+    return this->_header->num_nodes;
+}
@@ -1,42 +1,132 @@
 #pragma once
 #include <iostream>
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
 
+/**
+ * @brief Read-only memory mapping of a whole file
+ * Unmaps the file when the object goes out of scope
+*/
+class MappedFile {
+private:
+    const char* _data;
+    std::size_t _size;
+public:
+    MappedFile() : _data{nullptr}, _size{0} {};
+    MappedFile(const MappedFile& other) = delete;
+    MappedFile& operator=(const MappedFile& other) = delete;
+    ~MappedFile() { this->close(); }
+
+    /**
+     * @brief Maps the file at filename into memory
+     * @param filename (std::string) - path of the file to map
+     * @return (bool) - false if the file could not be opened or mapped
+    */
+    bool open(const std::string& filename);
+    void close();
+
+    const char* data() const { return this->_data; }
+    std::size_t size() const { return this->_size; }
+};
+
+/**
+ * @brief Node of a Trie over arbitrary byte strings
+ * 
+ * Children are keyed by byte (0-255), so lowercase, digits, punctuation and UTF-8
+ * sequences are all valid. To keep the wide alphabet from costing 256 pointers per
+ * node, the children live in a separately allocated block that adapts to the number
+ * of children, in the style of an Adaptive Radix Tree:
+ *  - Node4 / Node16: sorted key array next to a child array (Node16 is searched with SIMD)
+ *  - Node48: 256-entry byte index into 48 child slots
+ *  - Node256: direct child array
+ * Leaves have no block at all. The block grows as children are added and shrinks
+ * again as they are removed; the TrieNode itself never moves, so parents keep
+ * plain pointers to their children.
+*/
 class TrieNode {
 private:
-    TrieNode* _children[26];
+    struct Node4;
+    struct Node16;
+    struct Node48;
+    struct Node256;
+
+    enum Kind : uint8_t { NONE, NODE4, NODE16, NODE48, NODE256 };
+
+    void* _children;
+    uint16_t _num_children;
+    Kind _kind;
     bool _is_last_char;
+
+    /**
+     * @brief Moves the children into a freshly allocated block of the given kind
+    */
+    void _rebuild(Kind kind);
+    void _freeBlock();
 public:
     /**
      * @brief Constructor for TrieNode object
-     * Initializes _is_last_char and the _children array to nullptrs
+     * Initializes _is_last_char, the node starts without a child block
      * @param last_char (bool) - whether the node is the last character of a word
     */
     TrieNode(bool last_char = false);
 
+    TrieNode(const TrieNode& other) = delete;
+    TrieNode& operator=(const TrieNode& other) = delete;
+
     /**
      * @brief Destructor for TrieNode object
-     * Recursively deletes all children of the node
+     * Deletes all descendants of the node using an explicit stack, so deep words
+     * cannot overflow the call stack
     */
     ~TrieNode();
 
-    TrieNode*& getChild(char uppercaseLetter);
-    TrieNode*& operator[](char uppercaseLetter); // alias for getChild
+    /**
+     * @brief Returns the child along a byte
+     * @param key (char) - byte of the edge to follow
+     * @return (TrieNode*) - the child, or nullptr if there is none
+    */
+    TrieNode* getChild(char key) const;
+    TrieNode* operator[](char key) const; // alias for getChild
 
     /**
      * @brief Sets a child for the current node
      * 
-     * This function creates a new TrieNode with the specified last_char value
-     * and assigns it to the appropriate index in the _children array based on
-     * the given uppercaseLetter. The index is calculated by subtracting 'A' from
-     * the uppercaseLetter to get a value between 0 and 25, corresponding to each
-     * letter of the English alphabet.
+     * This function creates a new TrieNode with the specified last_char value and
+     * links it under key, growing the child block to the next tier if it is full.
      * 
-     * @param uppercaseLetter (char) - The uppercase letter for which to set the child node.
+     * @param key (char) - The byte for which to set the child node.
      * @param last_char (bool) - Indicates whether the new child node is the last character of a word.
+     * @return (TrieNode*) - the new child
      */
-    TrieNode* setChild(char uppercaseLetter, bool last_char = false);
+    TrieNode* setChild(char key, bool last_char = false);
 
-    void setChildNull(char uppercaseLetter);
+    /**
+     * @brief Links an existing node as the child under key, which must not have a child yet
+    */
+    void adoptChild(char key, TrieNode* child);
+
+    /**
+     * @brief Unlinks the child under key without deleting it, shrinking the block if it got sparse
+    */
+    void setChildNull(char key);
+
+    /**
+     * @brief Unlinks all children without deleting them and frees the child block
+    */
+    void releaseChildren();
+
+    /**
+     * @brief Finds the child with the smallest byte greater than key
+     * 
+     * Start with key = -1 to visit the children in byte order:
+     * `int key = -1; while (TrieNode* child = node->nextChild(key)) { ... }`
+     * 
+     * @param key (int) - previous byte, updated to the byte of the returned child
+     * @return (TrieNode*) - the next child, or nullptr once all children were visited
+    */
+    TrieNode* nextChild(int& key) const;
 
     bool isLastChar();
 
@@ -45,12 +135,67 @@ public:
     bool has_children();
 };
 
+/**
+ * @brief Range over the words stored strictly below a TrieNode, in alphabetical order
+ * 
+ * Iteration uses an explicit stack instead of recursion. Dereferencing yields a
+ * reference to a buffer owned by the iterator that holds the current word; it is
+ * overwritten by the next increment, so copy it if it must outlive the step. Once the
+ * stack and the buffer have grown to the depth of the deepest word, advancing does
+ * not allocate.
+*/
+class TrieWords {
+private:
+    TrieNode* _start;
+    std::string _prefix;
+public:
+    class iterator {
+    private:
+        struct Frame {
+            TrieNode* node;
+            int key; // byte of the last child visited, -1 before the first
+        };
+        std::vector<Frame> _stack;
+        std::string _word;
+        void _advance();
+    public:
+        iterator() = default;
+        iterator(TrieNode* start, const std::string& prefix);
+        const std::string& operator*() const { return this->_word; }
+        const std::string* operator->() const { return &this->_word; }
+        iterator& operator++() { this->_advance(); return *this; }
+        // only meaningful against end(): all exhausted iterators compare equal
+        bool operator==(const iterator& other) const { return this->_stack.empty() && other._stack.empty(); }
+        bool operator!=(const iterator& other) const { return !(*this == other); }
+    };
+
+    /**
+     * @param start (TrieNode*) - node whose descendants are listed, nullptr for an empty range
+     * @param prefix (std::string) - characters on the path to start, prepended to every word
+    */
+    TrieWords(TrieNode* start, const std::string& prefix = "") : _start{start}, _prefix{prefix} {};
+    iterator begin() const { return iterator(this->_start, this->_prefix); }
+    iterator end() const { return iterator(); }
+};
+
 class Trie {
 private:
     TrieNode* _root;
     unsigned int num_words;
     TrieNode* _findNode(const std::string& word);
 
+    /**
+     * @brief Inserts the characters word[0..len) below start
+     * @return (bool) - false if the word was already stored below start
+    */
+    static bool _insertAt(TrieNode* start, const char* word, std::size_t len);
+
+    /**
+     * @brief Moves every word stored below src into dst and deletes src
+     * @return (unsigned int) - number of words that were not already stored below dst
+    */
+    unsigned int _merge(TrieNode* dst, TrieNode* src);
+
 public:
     Trie() : _root{new TrieNode()}, num_words{0} {};
     ~Trie() {
@@ -71,19 +216,50 @@ public:
     */
     bool insert(const std::string& word);
 
-    bool erase(std::string& word);
+    /**
+     * @brief Inserts every whitespace-separated word of a file into the Trie
+     * 
+     * The file is memory-mapped and cut into one chunk per thread at whitespace
+     * boundaries. Each thread tokenizes its chunk into per-first-byte buckets,
+     * then every first byte gets its own subtrie built on a separate thread
+     * (in file order, so the result is identical to calling insert word by word).
+     * The finished subtries are spliced under the root, or merged into the
+     * existing child when the Trie already holds words with that first byte.
+     * 
+     * @param filename (std::string) - path of the file to load
+     * @param num_threads (unsigned int) - worker count, 0 picks the hardware concurrency
+     * @return (bool) - false if the file could not be opened
+     */
+    bool bulkLoad(const std::string& filename, unsigned int num_threads = 0);
 
-    bool eraseRecursive(std::string& word, TrieNode*& curr_node, int i = 0);
+    /**
+     * @brief Erases a word from the Trie
+     * 
+     * The path to the word is recorded on an explicit stack, then nodes that no longer
+     * lead to any word are pruned from the deepest one upwards.
+     * 
+     * @param word (std::string) - The word to erase.
+     * @return (bool) - true if the word's path was found and unmarked, false otherwise.
+     */
+    bool erase(std::string& word);
 
+    /**
+     * @brief Prints all words in alphabetical order on a single line
+     * The line is assembled in one buffer and written with a single call. No output if the Trie is empty.
+     */
     void printTrie();
 
-    void printTrieRecursive(TrieNode* root, std::string& word, bool& printed);
+    /**
+     * @brief Lists every word of the Trie that starts with prefix
+     * @param prefix (std::string) - prefix of the listed words; only words strictly longer are listed
+     * @return (TrieWords) - an empty range if the prefix is not in the Trie
+     */
+    TrieWords words(const std::string& prefix = "");
 
     /**
      * @brief Counts the total number of words stored in the Trie.
      * 
-     * This function initiates the recursive counting of words stored in the Trie by calling
-     * the numWordsRecursive function starting from the root node.
+     * The count is maintained by insert, erase, bulkLoad and clear, so no traversal is needed.
      * 
      * @return (unsigned int) - The total number of words in the Trie.
      */
@@ -95,7 +271,7 @@ public:
      * This function first finds the node corresponding to the last character of the prefix
      * using the _findNode function. If such a node does not exist (indicating that no word
      * in the Trie starts with the given prefix), it throws an std::invalid_argument exception.
-     * If the node is found, it then calls the numWordsRecursive function starting from this node
+     * If the node is found, it then calls the numWordsBelow function starting from this node
      * to count all words that extend from this prefix.
      * 
      * @param prefix (std::string) - The prefix for which to count the number of words.
@@ -107,23 +283,147 @@ public:
     void spellcheck(const std::string& word);
 
     /**
-     * @brief Recursively counts the number of words in the Trie.
+     * @brief Counts the number of words below a node of the Trie.
      * 
-     * This function traverses the Trie from a given node (root) downwards, counting the number
-     * of words. A word is identified by its last character node being marked as such. The function
-     * iterates through all possible child nodes (corresponding to letters 'A' to 'Z') of the current
-     * node. If a child node exists, it checks if it is marked as the last character of a word, in which
-     * case it increments the word count. It then recursively calls itself for the child node to continue
-     * the traversal. The count of words is accumulated and returned up the call stack.
+     * This function traverses the Trie from a given node (root) downwards with an explicit
+     * stack, counting the number of words. A word is identified by its last character node
+     * being marked as such. The root itself is not counted; callers add it when needed.
      * 
-     * @param root (TrieNode*) - The current node from which to count words.
-     * @param numWords (unsigned int) - The current count of words. Defaults to 0 for the initial call.
-     * @return (unsigned int) - The total number of words found from the current node downwards.
+     * @param root (TrieNode*) - The node below which to count words.
+     * @param numWords (unsigned int) - Count to add to. Defaults to 0.
+     * @return (unsigned int) - numWords plus the words found strictly below root.
      */
-    unsigned int numWordsRecursive(TrieNode* root, unsigned int numWords = 0);
+    unsigned int numWordsBelow(TrieNode* root, unsigned int numWords = 0);
 
     void clear();
 
     bool empty();
 
+    /**
+     * @brief Serializes the Trie into a flat, pointer-free TrieImage buffer
+     * 
+     * Nodes are numbered in breadth-first order starting with the root at 0, and
+     * the edges of each node are stored contiguously, sorted by label. Every node
+     * also stores the number of words at or below it so that prefix counts are
+     * answered without a traversal.
+     * 
+     * With minimize set, equivalent subtries (same end-of-word flag and same labelled
+     * children) are merged bottom-up into a single node, turning the Trie into a
+     * directed acyclic word graph. Shared suffixes such as "-ING" are then stored once.
+     * A node's word count only depends on the words below it, so it stays valid after
+     * merging and prefix counts work on the minimized graph too.
+     * 
+     * @param minimize (bool) - whether to merge equivalent subtries
+     * @return (std::vector<char>) - header, node array and edge array back to back
+     */
+    std::vector<char> buildImage(bool minimize = false);
+
+    /**
+     * @brief Writes buildImage(minimize) to a file
+     * @param filename (std::string) - path of the image to write
+     * @param minimize (bool) - whether to write the minimized word graph
+     * @return (bool) - false if the file could not be written
+     */
+    bool save(const std::string& filename, bool minimize = false);
+
+    /**
+     * @brief Counts the nodes of the Trie, including the root
+     */
+    unsigned int numNodes();
+
+};
+
+/*
+ * On-disk layout of a TrieImage: a header followed by the node array and the edge array.
+ * All offsets are indices into these arrays, so the image can be mapped at any address.
+*/
+struct TrieImageHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_nodes;
+    uint32_t num_edges;
+    uint32_t num_words;
+};
+
+struct TrieImageNode {
+    uint32_t first_edge;
+    uint32_t num_words; // words at or below this node
+    uint16_t num_edges;
+    uint8_t is_last;
+    uint8_t pad;
+};
+
+struct TrieImageEdge {
+    uint32_t target;
+    uint8_t label;
+    uint8_t pad[3];
+};
+
+/**
+ * @brief Read-only Trie served directly from a memory-mapped image written by Trie::save
+ * 
+ * Nothing is deserialized: queries walk the node and edge arrays inside the mapping,
+ * so every process opening the same image shares one physical copy through the page cache.
+*/
+class TrieImage {
+private:
+    MappedFile _file;
+    std::vector<char> _buffer; // backing storage when built in memory instead of mapped
+    const TrieImageHeader* _header;
+    const TrieImageNode* _nodes;
+    const TrieImageEdge* _edges;
+
+    /**
+     * @brief Returns the child of node along label, or -1 if there is none
+    */
+    int64_t _child(uint32_t node, char label) const;
+    bool _bind(const char* data, std::size_t size);
+    void _printBelow(uint32_t node, std::string& word, std::string& out) const;
+
+public:
+    static const char MAGIC[8];
+    static const uint32_t VERSION = 1;
+
+    TrieImage() : _header{nullptr}, _nodes{nullptr}, _edges{nullptr} {};
+    TrieImage(const TrieImage& other) = delete;
+    TrieImage& operator=(const TrieImage& other) = delete;
+
+    /**
+     * @brief Maps an image written by Trie::save
+     * @param filename (std::string) - path of the image
+     * @return (bool) - false if the file is missing, truncated or not a TrieImage
+    */
+    bool open(const std::string& filename);
+
+    /**
+     * @brief Serves an image built in memory, e.g. by Trie::buildImage(true)
+     * @param buffer (std::vector<char>) - image bytes, taken over by the TrieImage
+     * @return (bool) - false if the buffer is not a valid TrieImage
+    */
+    bool attach(std::vector<char>&& buffer);
+
+    void close();
+    bool isOpen() const { return this->_header != nullptr; }
+
+    /**
+     * @brief Same output as Trie::printTrie
+    */
+    void printTrie() const;
+
+    unsigned int numWords() const;
+
+    /**
+     * @brief Counts the words that start with prefix, read from the node's stored count
+     * @throws std::invalid_argument if the prefix is not found
+    */
+    unsigned int numWords(const std::string& prefix) const;
+
+    /**
+     * @brief Same output as Trie::spellcheck
+    */
+    void spellcheck(const std::string& word) const;
+
+    bool empty() const;
+
+    unsigned int numNodes() const;
 };
\ No newline at end of file
@@ -5,14 +5,50 @@
 #include <cassert>
 #include <fstream>
 #include <sstream>
+#include <chrono>
+#include <random>
+#include <cstdlib>
+#include <new>
+#include <algorithm>
+#include <iterator>
+#include <cmath>
+#include <climits>
+#include <thread>
+#include <atomic>
+#include <unordered_map>
+#include <cstdio>
+#include <cstddef>
 
 // # define TEST_MODE 0
+// the benchmarks are slow, so they run separately
+// # define BENCH_MODE 0
 
 void test_hash_table();
+void test_flat_hash_table();
+void test_lookup_allocations();
+void test_incremental_rehash();
+void test_remove();
+void test_tokenize();
+void test_load();
+void test_arena_table();
+void test_concurrent_dictionary();
+void test_vocab_image();
+void test_subword();
+void test_fixed_key_table();
+void test_stats();
+
+void bench_hash_tables(unsigned int num_words);
+void bench_insert_latency(unsigned int num_words);
+void bench_hash_policies(const std::string& filename);
+void bench_tokenize(const std::string& filename);
+void bench_miss_rate(double miss_rate, unsigned int num_lookups);
+void bench_fixed_key_table(unsigned int num_keys);
+void bench_subword(const std::string& filename);
+void bench_concurrent_lookups(unsigned int max_threads);
 
 int main(){
 
-    #ifndef TEST_MODE
+    #if !defined(TEST_MODE) && !defined(BENCH_MODE)
     std::string command;
     std::cin >> command;
     while (command != "create") {
@@ -24,6 +60,7 @@ int main(){
     std::cin >> size;
 
     Dictionary dict{size};
+    std::string out; // output buffer reused by tok_all and ret_all
     std::cout << "success" << std::endl;
 
     while (true) {
@@ -39,21 +76,27 @@ int main(){
             } else {
                 std::cout << "failure" << std::endl;
             }
+        } else if (command == "delete") {
+            std::string word;
+            std::cin >> word;
+            std::cout << (dict.remove(word) ? "success" : "failure") << std::endl;
+        } else if (command == "save") {
+            std::string filename;
+            std::cin >> filename;
+            std::cout << (dict.save(filename) ? "success" : "failure") << std::endl;
+        } else if (command == "open") {
+            // serve lookups from a saved vocabulary; insert, delete and load fail until close
+            std::string filename;
+            std::cin >> filename;
+            std::cout << (dict.open(filename) ? "success" : "failure") << std::endl;
+        } else if (command == "close") {
+            dict.close();
+            std::cout << "success" << std::endl;
         } else if (command == "load") {
             std::string filename;
             std::cin >> filename;
 
-            bool success = false;
-            std::ifstream file(filename.c_str());
-            std::string line;
-            while (std::getline(file, line)) {
-                std::istringstream iss(line);
-                std::string word;
-                while (iss >> word) {
-                    success |= dict.insert(word);
-                }
-            }
-            file.close();
+            bool success = dict.load(filename);
             std::cout << (success ? "success" : "failure") << std::endl;
 
         } else if (command == "tok") {
@@ -72,13 +115,16 @@ int main(){
             // print -1
             std::string line{};
             std::getline(std::cin, line);
-            std::istringstream iss(line);
-            std::string word;
-            while (iss >> word) {
-                int token = dict.token(word);
-                std::cout << token << " ";
+            std::vector<int32_t> tokens;
+            dict.tokenize(line.data(), line.size(), tokens);
+            out.clear();
+            for (int32_t token : tokens) {
+                out += std::to_string(token);
+                out += ' ';
             }
-            std::cout << std::endl;
+            out += '\n';
+            std::cout.write(out.data(), out.size());
+            std::cout.flush();
         } else if (command == "ret_all") { // TODO
             // Retrieve the words of all tokens, which
             // are separated by white spaces. For
@@ -86,21 +132,36 @@ int main(){
             std::string line{};
 
             std::getline(std::cin, line); 
-            std::istringstream ss(line);
-            std::string something;
-
-            // Parse the line using a string stream
-            while (ss >> something) {
-                int index = std::stoi(something);
-                std::string word = dict.ret(index);
-                std::cout << word << " ";
+            out.clear();
+
+            // Parse the tokens in place and append views of the words to the reused output buffer
+            const char* p = line.c_str();
+            char* next;
+            for (long index = std::strtol(p, &next, 10); next != p; index = std::strtol(p, &next, 10)) {
+                p = next;
+                StringRef word = dict.ret_view(index < INT_MIN || index > INT_MAX ? -1 : static_cast<int>(index));
+                out.append(word.data, word.size);
+                out += ' ';
             }
-        
-            std::cout << std::endl;
+            out += '\n';
+            std::cout.write(out.data(), out.size());
+            std::cout.flush();
         } else if (command == "print") {
             int k;
             std::cin >> k;
             dict.print(k);
+        } else if (command == "histogram") {
+            // chain length : number of buckets
+            std::vector<unsigned int> histogram = dict.chain_length_histogram();
+            for (std::size_t n = 0; n < histogram.size(); n++) {
+                if (histogram[n] != 0)
+                    std::cout << n << ":" << histogram[n] << " ";
+            }
+            std::cout << std::endl;
+        } else if (command == "stats") {
+            dict.stats().print(std::cout);
+        } else if (command == "stats_json") {
+            std::cout << dict.stats().to_json() << std::endl;
         } else if (command == "exit")  {
             break;
         }
@@ -123,14 +184,38 @@ int main(){
     dict.insert("kang");
 
     test_hash_table();
+    test_flat_hash_table();
+    test_lookup_allocations();
+    test_incremental_rehash();
+    test_remove();
+    test_tokenize();
+    test_load();
+    test_arena_table();
+    test_concurrent_dictionary();
+    test_vocab_image();
+    test_subword();
+    test_fixed_key_table();
+    test_stats();
+    #endif
+
+    #ifdef BENCH_MODE
+    bench_hash_tables(1000000);
+    bench_insert_latency(2000000);
+    bench_hash_policies("files/pj_dictionary.txt");
+    bench_tokenize("files/prepostera.txt");
+    for (double miss_rate : {0.0, 0.1, 0.5, 0.9})
+        bench_miss_rate(miss_rate, 1000000);
+    bench_concurrent_lookups(64);
+    bench_subword("files/prepostera.txt");
+    bench_fixed_key_table(1000000);
     #endif
 
     return 0;
 }
 
 void test_hash_table() {
-    // Test the HashTable with string keys and integer values
-    HashTable<std::string, int> hashTable{10};
+    // Test the HashTable with string keys and integer values, using the assignment's hash
+    HashTable<std::string, int, PolynomialHash> hashTable{10};
 
     // Test insert method
     hashTable.insert(std::make_pair("keyA", 1));
@@ -159,6 +244,210 @@ void test_hash_table() {
     std::cout << "All Hash table tests passed successfully!" << std::endl;
 }
 
+void test_flat_hash_table() {
+    FlatHashTable<std::string, int> hashTable{10};
+
+    // Test insert method, including growth past the initial 16 slots
+    std::string key = "key";
+    for (int i = 0; i < 100; i++) {
+        key.push_back('a' + i % 26);
+        assert(hashTable.insert(std::make_pair(key, i)));
+    }
+    assert(!hashTable.insert(std::make_pair(std::string("keya"), 7)));
+    assert(!hashTable.insert(std::make_pair(std::string("key1"), 7)));
+
+    // Test get method
+    key = "key";
+    for (int i = 0; i < 100; i++) {
+        key.push_back('a' + i % 26);
+        assert(hashTable.get(key) == i);
+    }
+    bool thrown = false;
+    try {
+        hashTable.get("missing");
+    } catch (const KeyError& e) {
+        thrown = true;
+    }
+    assert(thrown);
+
+    assert(hashTable.get_size() == 100);
+    assert(hashTable.get_max_size() == 128);
+
+    std::cout << "All flat hash table tests passed successfully!" << std::endl;
+}
+
+#ifdef TEST_MODE
+// Counts every heap allocation made by the program, for test_lookup_allocations.
+// Atomic because the concurrent tests allocate from several threads.
+static std::atomic<unsigned long> num_allocations{0};
+
+void* operator new(std::size_t size) {
+    num_allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* ptr = std::malloc(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* ptr) noexcept {
+    std::free(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept {
+    std::free(ptr);
+}
+#endif
+
+void test_lookup_allocations() {
+    #ifdef TEST_MODE
+    Dictionary dict{4};
+    const char* text = "the quick brown fox jumps over the lazy dog";
+    std::istringstream iss(text);
+    std::string word;
+    while (iss >> word)
+        dict.insert(word);
+
+    // growth happened above, from here on the table is only read
+    std::string hit = "lazy", miss = "cat";
+    unsigned long before = num_allocations.load(std::memory_order_relaxed);
+    assert(dict.token(hit) == 7);
+    assert(dict.token(miss) == -1);
+    assert(dict.token(text + 4, 5) == 2); // "quick", straight out of the text
+    assert(dict.token(text, 2) == -1); // "th"
+    assert(!dict.insert("fox")); // duplicate insert is rejected before building a key
+    assert(num_allocations.load(std::memory_order_relaxed) == before);
+
+    std::cout << "All lookup allocation tests passed successfully!" << std::endl;
+    #endif
+}
+
+/**
+ * @brief Compares token lookups in the chained and the flat hash table.
+ * Inserts num_words random lowercase words into both tables, then looks up every word
+ * once (hits) and as many words that were never inserted (misses).
+ * @param num_words Vocabulary size.
+ */
+void bench_hash_tables(unsigned int num_words) {
+    std::mt19937 rng(250);
+    std::uniform_int_distribution<int> length(3, 12);
+    std::uniform_int_distribution<int> letter(0, 25);
+    auto random_word = [&]() {
+        std::string word(length(rng), 'a');
+        for (auto& c : word)
+            c = 'a' + letter(rng);
+        return word;
+    };
+    std::vector<std::string> words, unknown;
+    for (unsigned int i = 0; i < num_words; i++)
+        words.push_back(random_word());
+    for (unsigned int i = 0; i < num_words; i++)
+        unknown.push_back(random_word() + "Q"); // never generated above
+
+    using clock = std::chrono::steady_clock;
+    auto ns_per_op = [num_words](clock::time_point start) {
+        return std::chrono::duration<double, std::nano>(clock::now() - start).count() / num_words;
+    };
+
+    HashTable<std::string, int> chained{1024};
+    FlatHashTable<std::string, int> flat{1024};
+    long checksum = 0;
+
+    auto start = clock::now();
+    for (unsigned int i = 0; i < num_words; i++)
+        chained.insert({words[i], static_cast<int>(i)});
+    double chained_insert = ns_per_op(start);
+    start = clock::now();
+    for (unsigned int i = 0; i < num_words; i++)
+        flat.insert({words[i], static_cast<int>(i)});
+    double flat_insert = ns_per_op(start);
+
+    start = clock::now();
+    for (const auto& word : words)
+        checksum += chained.get(word);
+    double chained_hit = ns_per_op(start);
+    start = clock::now();
+    for (const auto& word : words)
+        checksum -= flat.get(word);
+    double flat_hit = ns_per_op(start);
+
+    start = clock::now();
+    for (const auto& word : unknown) {
+        try { checksum += chained.get(word); } catch (const KeyError& e) { checksum--; }
+    }
+    double chained_miss = ns_per_op(start);
+    start = clock::now();
+    for (const auto& word : unknown) {
+        try { checksum += flat.get(word); } catch (const KeyError& e) { checksum++; }
+    }
+    double flat_miss = ns_per_op(start);
+
+    assert(checksum == 0);
+    std::cout << "words: " << num_words << " (" << chained.get_size() << " distinct)" << std::endl;
+    std::cout << "chained ns/op: insert " << chained_insert << " hit " << chained_hit << " miss " << chained_miss << std::endl;
+    std::cout << "flat    ns/op: insert " << flat_insert << " hit " << flat_hit << " miss " << flat_miss << std::endl;
+}
+
+void test_incremental_rehash() {
+    HashTable<std::string, int> hashTable{4};
+    hashTable.set_incremental(true);
+
+    std::vector<std::string> keys;
+    std::string key;
+    for (int i = 0; i < 5000; i++) {
+        key.clear();
+        for (int n = i; n > 0 || key.empty(); n /= 26)
+            key.push_back('a' + n % 26);
+        keys.push_back(key);
+        assert(hashTable.insert(std::make_pair(key, i)));
+        // every key inserted so far stays reachable mid-migration
+        if (hashTable.is_rehashing()) {
+            for (int j = 0; j <= i; j += 97)
+                assert(hashTable.get(keys[j]) == j);
+        }
+    }
+    assert(!hashTable.insert(std::make_pair(keys[1234], 0)));
+    hashTable.set_incremental(false);
+    assert(!hashTable.is_rehashing());
+    for (int i = 0; i < 5000; i++)
+        assert(hashTable.get(keys[i]) == i);
+    assert(hashTable.get_size() == 5000);
+
+    std::cout << "All incremental rehash tests passed successfully!" << std::endl;
+}
+
+/**
+ * @brief Measures the latency distribution of single inserts with synchronous and incremental resizing.
+ * @param num_words Number of distinct words inserted into each table.
+ */
+void bench_insert_latency(unsigned int num_words) {
+    std::vector<std::string> words;
+    std::string key;
+    for (unsigned int i = 0; i < num_words; i++) {
+        key.clear();
+        for (unsigned int n = i; n > 0 || key.empty(); n /= 26)
+            key.push_back('a' + n % 26);
+        words.push_back(key);
+    }
+
+    using clock = std::chrono::steady_clock;
+    for (bool incremental : {false, true}) {
+        HashTable<std::string, int> table{1024};
+        table.set_incremental(incremental);
+        std::vector<double> latency(num_words);
+        for (unsigned int i = 0; i < num_words; i++) {
+            auto start = clock::now();
+            table.insert(std::make_pair(words[i], static_cast<int>(i)));
+            latency[i] = std::chrono::duration<double, std::micro>(clock::now() - start).count();
+        }
+        std::sort(latency.begin(), latency.end());
+        auto percentile = [&latency](double p) {
+            return latency[static_cast<std::size_t>(p * (latency.size() - 1))];
+        };
+        std::cout << (incremental ? "incremental" : "synchronous") << " insert us:"
+                  << " p50 " << percentile(0.5) << " p99 " << percentile(0.99)
+                  << " p99.9 " << percentile(0.999) << " max " << latency.back() << std::endl;
+    }
+}
+
 /*
 WHAT I LEARNED FROM SAD 9hr DEBUGGING SESSION:
 Why changing the object declaration from `Dictionary dict; dict = Dictionary{4};` to `Dictionary dict{4};` resolved the problem:
@@ -210,4 +499,800 @@ In summary, the issue was caused by the unintended destruction of the temporary
 
 This highlights the importance of properly managing object lifetimes and being cautious when using assignment operators,
  especially when dealing with objects that manage dynamic memory allocation.
-*/
\ No newline at end of file
+*/
+/**
+ * @brief Loads the words into a table with the given hash policy and prints the longest and mean
+ * chain (or probe) length, along with the lookup time per word.
+ */
+template <template<typename, typename, typename> class table_t, typename hash_t>
+static void report_hash_policy(const char* name, const std::vector<std::string>& words,
+                               std::vector<unsigned int> (table_t<std::string, int, hash_t>::*histogram)() const) {
+    table_t<std::string, int, hash_t> table{1024};
+    for (unsigned int i = 0; i < words.size(); i++)
+        table.insert(std::make_pair(words[i], static_cast<int>(i)));
+
+    using clock = std::chrono::steady_clock;
+    long checksum = 0;
+    auto start = clock::now();
+    for (const auto& word : words)
+        checksum += table.get(word);
+    double ns = std::chrono::duration<double, std::nano>(clock::now() - start).count() / words.size();
+
+    std::vector<unsigned int> counts = (table.*histogram)();
+    double total = 0, weighted = 0;
+    for (std::size_t n = 0; n < counts.size(); n++) {
+        total += counts[n];
+        weighted += static_cast<double>(n) * counts[n];
+    }
+    std::cout << name << ": max " << counts.size() - 1 << " mean " << weighted / total
+              << " hit ns/op " << ns << " (checksum " << checksum << ")" << std::endl;
+}
+
+/**
+ * @brief Compares the distribution of chain and probe lengths of the hash policies on a corpus.
+ * @param filename Whitespace-separated corpus.
+ */
+void bench_hash_policies(const std::string& filename) {
+    std::ifstream file(filename.c_str());
+    std::vector<std::string> words;
+    std::string word;
+    while (file >> word) {
+        // keys must be purely alphabetic
+        if (std::all_of(word.begin(), word.end(), [](char c) { return std::isalpha(c) != 0; }))
+            words.push_back(word);
+    }
+    std::cout << filename << ": " << words.size() << " words" << std::endl;
+
+    report_hash_policy<HashTable, PolynomialHash>("chained polynomial chain length", words,
+        &HashTable<std::string, int, PolynomialHash>::chain_length_histogram);
+    report_hash_policy<HashTable, WyHash>("chained wyhash     chain length", words,
+        &HashTable<std::string, int, WyHash>::chain_length_histogram);
+    report_hash_policy<FlatHashTable, WyHash>("flat wyhash        probe groups", words,
+        &FlatHashTable<std::string, int, WyHash>::probe_length_histogram);
+}
+
+void test_remove() {
+    std::vector<std::string> keys;
+    std::string key;
+    for (int i = 0; i < 20000; i++) {
+        key.clear();
+        for (int n = i; n > 0 || key.empty(); n /= 26)
+            key.push_back('a' + n % 26);
+        keys.push_back(key);
+    }
+
+    // chained: removal unlinks, shrinking keeps the initial capacity as a floor
+    HashTable<std::string, int, PolynomialHash> chained{10};
+    for (int i = 0; i < 1000; i++)
+        chained.insert(std::make_pair(keys[i], i));
+    assert(!chained.remove("missing"));
+    for (int i = 0; i < 1000; i += 2)
+        assert(chained.remove(keys[i]));
+    assert(!chained.remove(keys[0]));
+    assert(chained.get_size() == 500);
+    for (int i = 1; i < 1000; i += 2)
+        assert(chained.get(keys[i]) == i);
+    for (int i = 1; i < 990; i += 2)
+        chained.remove(keys[i]);
+    assert(chained.get_size() == 5);
+    assert(chained.get_max_size() < 1280 && chained.get_max_size() >= 10);
+    for (int i = 991; i < 1000; i += 2)
+        assert(chained.get(keys[i]) == i);
+
+    // chained removal in the middle of an incremental resize
+    HashTable<std::string, int> incremental{4};
+    incremental.set_incremental(true);
+    std::vector<bool> removed(3000, false);
+    for (int i = 0; i < 3000; i++) {
+        incremental.insert(std::make_pair(keys[i], i));
+        if (incremental.is_rehashing() && !removed[i / 2]) {
+            assert(incremental.remove(keys[i / 2]));
+            removed[i / 2] = true;
+        }
+    }
+    for (int i = 0; i < 3000; i++)
+        assert((incremental.find(keys[i]) == nullptr) == removed[i]);
+
+    // flat: churn through many more keys than the table holds at once
+    FlatHashTable<std::string, int> flat{16};
+    const int live = 1000;
+    for (int i = 0; i < 20000; i++) {
+        assert(flat.insert(std::make_pair(keys[i], i)));
+        if (i >= live)
+            assert(flat.remove(keys[i - live]));
+    }
+    assert(flat.get_size() == live);
+    assert(flat.get_max_size() <= 4096);
+    for (int i = 20000 - live; i < 20000; i++)
+        assert(flat.get(keys[i]) == i);
+    std::vector<unsigned int> probes = flat.probe_length_histogram();
+    assert(probes.size() <= 4);
+    for (int i = 20000 - live; i < 20000; i++)
+        assert(flat.remove(keys[i]));
+    assert(flat.get_size() == 0 && flat.get_max_size() == 16);
+
+    // dictionary: freed tokens are reused, most recently freed first
+    Dictionary dict(4);
+    dict.insert("alpha");
+    dict.insert("beta");
+    dict.insert("gamma");
+    assert(dict.remove("beta"));
+    assert(!dict.remove("beta"));
+    assert(dict.token("beta") == -1);
+    assert(dict.ret(2) == "N/A");
+    assert(dict.remove("alpha"));
+    assert(dict.insert("delta"));
+    assert(dict.token("delta") == 1);
+    assert(dict.insert("epsilon"));
+    assert(dict.token("epsilon") == 2);
+    assert(dict.insert("zeta"));
+    assert(dict.token("zeta") == 4);
+    assert(dict.ret(3) == "gamma");
+
+    std::cout << "All remove tests passed successfully!" << std::endl;
+}
+
+void test_tokenize() {
+    Dictionary dict(16);
+    for (const char* word : {"the", "quick", "brown", "fox", "jumps", "over", "lazy", "dog"})
+        dict.insert(word);
+
+    // words straddling the 16-byte blocks, every kind of whitespace, and unknown words
+    std::string text = " \tthe  quick\nbrown\r\ffox\vjumps over the lazy dog cat  quickly the";
+    for (int i = 0; i < 3; i++)
+        text += text;
+    std::vector<int32_t> expected;
+    std::istringstream iss(text);
+    std::string word;
+    while (iss >> word)
+        expected.push_back(dict.token(word));
+
+    std::vector<int32_t> tokens;
+    assert(dict.tokenize(text.data(), text.size(), tokens) == expected.size());
+    assert(tokens == expected);
+
+    // the buffer variant resumes where it stopped
+    std::vector<int32_t> chunked;
+    int32_t buffer[5];
+    std::size_t offset = 0, consumed = 0, count;
+    while ((count = dict.tokenize(text.data() + offset, text.size() - offset, buffer, 5, consumed)) > 0) {
+        chunked.insert(chunked.end(), buffer, buffer + count);
+        offset += consumed;
+    }
+    assert(chunked == expected);
+
+    tokens.clear();
+    assert(dict.tokenize("  \n ", 4, tokens) == 0);
+    assert(!dict.tokenize_file("files/does_not_exist.txt", tokens));
+
+    std::cout << "All tokenize tests passed successfully!" << std::endl;
+}
+
+/**
+ * @brief Compares the throughput of the istringstream loop tok_all used to run with the
+ * single-pass tokenizer over a memory-mapped file.
+ * @param filename Corpus used both to fill the dictionary and as the text to tokenize.
+ */
+void bench_tokenize(const std::string& filename) {
+    std::ifstream file(filename.c_str());
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    Dictionary dict(1024);
+    std::istringstream words(text);
+    std::string word;
+    while (words >> word)
+        dict.insert(word);
+
+    using clock = std::chrono::steady_clock;
+    auto mb_per_s = [&text](clock::time_point start) {
+        return text.size() / std::chrono::duration<double>(clock::now() - start).count() / 1e6;
+    };
+
+    long checksum = 0;
+    auto start = clock::now();
+    std::istringstream iss(text);
+    while (iss >> word)
+        checksum += dict.token(word);
+    double stream_rate = mb_per_s(start);
+
+    std::vector<int32_t> tokens;
+    start = clock::now();
+    dict.tokenize_file(filename, tokens);
+    double bulk_rate = mb_per_s(start);
+    for (int32_t token : tokens)
+        checksum -= token;
+
+    assert(checksum == 0);
+    std::cout << filename << ": " << tokens.size() << " words, istringstream " << stream_rate
+              << " MB/s, tokenize_file " << bulk_rate << " MB/s" << std::endl;
+}
+
+/**
+ * @brief Compares lookups that report a miss with a KeyError against find and try_get.
+ * @param miss_rate Fraction of the lookups, between 0 and 1, for words not in the table.
+ * @param num_lookups Number of lookups timed for each API.
+ */
+void bench_miss_rate(double miss_rate, unsigned int num_lookups) {
+    const unsigned int vocabulary = 100000;
+    HashTable<std::string, int> table{1024};
+    std::vector<std::string> known, queries;
+    std::string key;
+    for (unsigned int i = 0; i < vocabulary; i++) {
+        key.clear();
+        for (unsigned int n = i; n > 0 || key.empty(); n /= 26)
+            key.push_back('a' + n % 26);
+        table.insert(std::make_pair(key, static_cast<int>(i)));
+        known.push_back(key);
+    }
+    std::mt19937 rng(250);
+    std::uniform_int_distribution<unsigned int> pick(0, vocabulary - 1);
+    std::bernoulli_distribution miss(miss_rate);
+    for (unsigned int i = 0; i < num_lookups; i++)
+        queries.push_back(miss(rng) ? known[pick(rng)] + "Q" : known[pick(rng)]);
+
+    using clock = std::chrono::steady_clock;
+    auto ns_per_op = [num_lookups](clock::time_point start) {
+        return std::chrono::duration<double, std::nano>(clock::now() - start).count() / num_lookups;
+    };
+
+    long throwing = 0, finding = 0, trying = 0;
+    auto start = clock::now();
+    for (const auto& word : queries) {
+        try { throwing += table.get(word); } catch (const KeyError& e) { throwing--; }
+    }
+    double get_ns = ns_per_op(start);
+
+    start = clock::now();
+    for (const auto& word : queries) {
+        const int* value = table.find(word);
+        finding += value == nullptr ? -1 : *value;
+    }
+    double find_ns = ns_per_op(start);
+
+    start = clock::now();
+    for (const auto& word : queries) {
+        int value = -1;
+        table.try_get(word, value);
+        trying += value;
+    }
+    double try_get_ns = ns_per_op(start);
+
+    assert(throwing == finding && finding == trying);
+    std::cout << "miss rate " << miss_rate << " ns/op: get+catch " << get_ns << " find " << find_ns
+              << " try_get " << try_get_ns << std::endl;
+}
+
+/**
+ * @brief Writes num_words words drawn from a Zipf-like vocabulary, mixed with words the
+ * dictionary rejects, to a temporary corpus file.
+ * @return The path of the file.
+ */
+static std::string write_corpus(unsigned int num_words, unsigned int vocabulary) {
+    std::string filename = "/tmp/tokenize_corpus.txt";
+    std::ofstream file(filename.c_str());
+    std::mt19937 rng(250);
+    std::uniform_real_distribution<double> unit(0.0, 1.0);
+    std::string key;
+    for (unsigned int i = 0; i < num_words; i++) {
+        unsigned int n = static_cast<unsigned int>(std::pow(static_cast<double>(vocabulary), unit(rng)));
+        key.clear();
+        for (; n > 0 || key.empty(); n /= 26)
+            key.push_back('a' + n % 26);
+        if (i % 17 == 0)
+            key += "42";
+        file << key << (i % 12 == 11 ? "\n" : " ");
+    }
+    return filename;
+}
+
+void test_load() {
+    std::string filename = write_corpus(300000, 200000);
+    Dictionary loaded(16), inserted(16);
+    loaded.insert("zzzz"); // words already present are skipped
+    inserted.insert("zzzz");
+    assert(loaded.load(filename));
+    // tokens follow first occurrence in the file, as with one insert per word
+    std::ifstream file(filename.c_str());
+    std::string word;
+    while (file >> word)
+        inserted.insert(word);
+    for (int token = 1; inserted.ret(token) != "N/A"; token++)
+        assert(loaded.ret(token) == inserted.ret(token));
+    assert(loaded.ret(inserted.num_tokens()) == "N/A");
+    assert(!loaded.load(filename));
+    assert(!loaded.load("files/does_not_exist.txt"));
+    std::remove(filename.c_str());
+
+    std::cout << "All load tests passed successfully!" << std::endl;
+}
+
+/**
+ * @brief Captures what print(k) writes for every bucket of a table.
+ */
+template <typename table_t>
+static std::string print_all(const table_t& table) {
+    std::ostringstream captured;
+    std::streambuf* original = std::cout.rdbuf(captured.rdbuf());
+    for (unsigned int k = 0; k < table.get_max_size(); k++)
+        table.print(k);
+    std::cout.rdbuf(original);
+    return captured.str();
+}
+
+void test_arena_table() {
+    // the arena-keyed table lays out its chains exactly like the string-keyed one
+    StringArena arena;
+    ArenaHashTable<int, PolynomialHash> keyed{10, &arena};
+    HashTable<std::string, int, PolynomialHash> reference{10};
+    std::string key;
+    for (int i = 0; i < 2000; i++) {
+        key.clear();
+        for (int n = i; n > 0 || key.empty(); n /= 26)
+            key.push_back('a' + n % 26);
+        ArenaKey location;
+        assert(keyed.try_emplace(key.data(), key.size(), i, location) == reference.try_emplace(key, i));
+        assert(std::string(arena.data(location), location.len) == key);
+    }
+    ArenaKey location;
+    assert(!keyed.try_emplace("abc1", 4, 0, location));
+    assert(keyed.get_size() == reference.get_size() && keyed.get_max_size() == reference.get_max_size());
+    assert(print_all(keyed) == print_all(reference));
+    assert(*keyed.find("bb", 2) == 27);
+    assert(keyed.remove("bb", 2) && keyed.find("bb", 2) == nullptr && !keyed.remove("bb", 2));
+
+    // it shares the chained table's incremental resizing, which Dictionary can switch on
+    StringArena growing_arena;
+    ArenaHashTable<int, PolynomialHash> growing{4, &growing_arena};
+    growing.set_incremental(true);
+    std::vector<std::string> keys;
+    bool migrated = false;
+    for (int i = 0; i < 5000; i++) {
+        key.clear();
+        for (int n = i; n > 0 || key.empty(); n /= 26)
+            key.push_back('a' + n % 26);
+        keys.push_back(key);
+        assert(growing.try_emplace(key.data(), key.size(), i, location));
+        if (growing.is_rehashing()) {
+            migrated = true;
+            for (int j = i % 97; j <= i; j += 97)
+                assert(*growing.find(keys[j].data(), keys[j].size()) == j);
+        }
+    }
+    growing.set_incremental(false);
+    assert(migrated && !growing.is_rehashing());
+    for (int i = 0; i < 5000; i++)
+        assert(*growing.find(keys[i].data(), keys[i].size()) == i);
+
+    // ret_view points into the arena, and freed tokens read as N/A until reused
+    Dictionary dict(4);
+    dict.set_incremental(true);
+    dict.insert("alpha");
+    dict.insert("beta");
+    dict.insert("delta");
+    dict.insert("epsilon");
+    StringRef word = dict.ret_view(2);
+    assert(std::string(word.data, word.size) == "beta");
+    assert(dict.remove("alpha"));
+    word = dict.ret_view(1);
+    assert(std::string(word.data, word.size) == "N/A");
+    dict.insert("gamma");
+    assert(dict.ret(1) == "gamma" && dict.token("gamma") == 1 && dict.token("alpha") == -1);
+
+    // under insert/remove churn the arena stays bounded by the live words
+    Dictionary churned(1024);
+    std::vector<std::string> live;
+    unsigned int next_word = 0;
+    auto fresh_word = [&next_word]() {
+        // base 25 over a..y, then a run of z of varying length
+        std::string word;
+        for (unsigned int n = next_word; n > 0 || word.empty(); n /= 25)
+            word.push_back('a' + n % 25);
+        word.append(next_word++ % 17, 'z');
+        return word;
+    };
+    for (int i = 0; i < 2000; i++) {
+        live.push_back(fresh_word());
+        assert(churned.insert(live.back()));
+    }
+    const uint64_t filled = churned.stats().bytes;
+    for (int round = 0; round < 200; round++) {
+        for (int i = 0; i < 100; i++) {
+            const std::size_t victim = (round * 131 + i * 17) % live.size();
+            assert(churned.remove(live[victim]));
+            live[victim] = fresh_word();
+            assert(churned.insert(live[victim]));
+        }
+        assert(churned.stats().bytes <= 2 * filled);
+    }
+    for (const auto& word : live)
+        assert(churned.ret(churned.token(word)) == word);
+
+    std::cout << "All arena table tests passed successfully!" << std::endl;
+}
+
+/**
+ * @brief The i-th word of the generated test vocabulary.
+ */
+static std::string nth_word(unsigned int i) {
+    std::string key;
+    for (unsigned int n = i; n > 0 || key.empty(); n /= 26)
+        key.push_back('a' + n % 26);
+    return key;
+}
+
+void test_concurrent_dictionary() {
+    const unsigned int num_threads = 8, num_words = 20000;
+    ConcurrentDictionary dict(4);
+    std::atomic<unsigned int> inserted{0};
+    std::vector<std::thread> workers;
+    // every thread inserts every word, in a different order, and checks what it can read
+    for (unsigned int t = 0; t < num_threads; t++) {
+        workers.emplace_back([&, t]() {
+            for (unsigned int k = 0; k < num_words; k++) {
+                unsigned int i = (k * 7919 + t * 104729) % num_words;
+                std::string word = nth_word(i);
+                if (dict.insert(word))
+                    inserted++;
+                int token = dict.token(word);
+                assert(token > 0 && dict.ret(token) == word);
+            }
+        });
+    }
+    for (auto& w : workers)
+        w.join();
+
+    assert(inserted == num_words && dict.size() == num_words);
+    std::vector<bool> seen(num_words + 1, false);
+    for (unsigned int i = 0; i < num_words; i++) {
+        int token = dict.token(nth_word(i));
+        assert(token >= 1 && token <= static_cast<int>(num_words) && !seen[token]);
+        seen[token] = true;
+    }
+    assert(dict.token("missing") == -1 && dict.ret(num_words + 1) == "N/A" && dict.ret(0) == "N/A");
+    assert(!dict.insert("abc1"));
+    std::vector<int32_t> tokens;
+    std::string text = " a  b\tmissing ";
+    assert(dict.tokenize(text.data(), text.size(), tokens) == 3 && tokens[2] == -1);
+
+    std::cout << "All concurrent dictionary tests passed successfully!" << std::endl;
+}
+
+/**
+ * @brief Measures token() throughput over 1, 2, 4, ... max_threads reader threads while
+ * one writer keeps inserting new words at about 10000 per second.
+ * @param max_threads The largest number of readers.
+ */
+void bench_concurrent_lookups(unsigned int max_threads) {
+    const unsigned int vocabulary = 100000;
+    ConcurrentDictionary dict;
+    std::vector<std::string> words;
+    for (unsigned int i = 0; i < vocabulary; i++) {
+        words.push_back(nth_word(i));
+        dict.insert(words.back());
+    }
+
+    unsigned int next_word = vocabulary;
+    for (unsigned int num_threads = 1; num_threads <= max_threads; num_threads *= 2) {
+        std::atomic<bool> stop{false};
+        std::atomic<unsigned long> lookups{0};
+        std::thread writer([&]() {
+            while (!stop.load()) {
+                dict.insert(nth_word(next_word++));
+                std::this_thread::sleep_for(std::chrono::microseconds(100));
+            }
+        });
+        std::vector<std::thread> readers;
+        for (unsigned int t = 0; t < num_threads; t++) {
+            readers.emplace_back([&, t]() {
+                std::mt19937 rng(t);
+                std::uniform_int_distribution<unsigned int> pick(0, vocabulary - 1);
+                unsigned long count = 0;
+                long checksum = 0;
+                while (!stop.load(std::memory_order_relaxed)) {
+                    for (int i = 0; i < 256; i++)
+                        checksum += dict.token(words[pick(rng)]);
+                    count += 256;
+                }
+                assert(checksum > 0);
+                lookups += count;
+            });
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(200));
+        stop = true;
+        for (auto& r : readers)
+            r.join();
+        writer.join();
+        std::cout << "concurrent token() with " << num_threads << " threads: "
+                  << lookups / 0.2 / 1e6 << " M lookups/s" << std::endl;
+    }
+}
+
+void test_vocab_image() {
+    const std::string image = "/tmp/tokenize_vocab.bin";
+    Dictionary built(16);
+    assert(built.load("files/pj_dictionary.txt"));
+    built.remove("the"); // a hole in the token table
+    assert(built.save(image));
+
+    using clock = std::chrono::steady_clock;
+    Dictionary served(4);
+    auto start = clock::now();
+    assert(served.open(image));
+    double open_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    start = clock::now();
+    Dictionary reloaded(16);
+    reloaded.load("files/pj_dictionary.txt");
+    double load_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+
+    std::vector<int32_t> expected, tokens;
+    assert(built.tokenize_file("files/pj_dictionary.txt", expected));
+    assert(served.tokenize_file("files/pj_dictionary.txt", tokens));
+    assert(tokens == expected);
+    for (int token = 0; token <= static_cast<int>(expected.size()); token++)
+        assert(served.ret(token) == built.ret(token));
+    assert(served.token("the") == -1);
+
+    // read-only while open, the in-memory words come back on close
+    assert(!served.insert("newword") && !served.remove("and") && !served.save(image));
+    served.close();
+    assert(served.insert("newword") && served.token("newword") == 1);
+    assert(!served.open("files/pj_dictionary.txt"));
+
+    // corrupt images are rejected by open rather than read out of bounds later
+    std::string bytes;
+    {
+        std::ifstream in(image.c_str(), std::ios::binary);
+        bytes.assign(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+    }
+    VocabImageHeader header;
+    std::memcpy(&header, bytes.data(), sizeof(header));
+    const std::size_t words_at = sizeof(VocabImageHeader);
+    const std::size_t index_at = words_at + std::size_t(header.num_tokens) * sizeof(ArenaKey);
+    auto rejects = [&](const std::string& corrupt) {
+        std::ofstream out(image.c_str(), std::ios::binary);
+        out.write(corrupt.data(), corrupt.size());
+        out.close();
+        Dictionary dict(4);
+        return !dict.open(image);
+    };
+    assert(!rejects(bytes));
+    assert(rejects(bytes.substr(0, bytes.size() - 1)));
+    std::string corrupt = bytes;
+    const uint32_t past_arena = header.arena_size;
+    std::memcpy(&corrupt[words_at + sizeof(ArenaKey) + offsetof(ArenaKey, offset)], &past_arena, sizeof(uint32_t));
+    assert(rejects(corrupt));
+    corrupt = bytes;
+    const uint32_t no_token = header.num_tokens;
+    for (std::size_t i = 0; i < header.index_capacity; i++) {
+        if (std::memcmp(&corrupt[index_at + i * sizeof(uint32_t)], "\0\0\0\0", 4) != 0) {
+            std::memcpy(&corrupt[index_at + i * sizeof(uint32_t)], &no_token, sizeof(uint32_t));
+            break;
+        }
+    }
+    assert(rejects(corrupt));
+    corrupt = bytes;
+    const uint32_t first_token = 1;
+    for (std::size_t i = 0; i < header.index_capacity; i++)
+        std::memcpy(&corrupt[index_at + i * sizeof(uint32_t)], &first_token, sizeof(uint32_t));
+    assert(rejects(corrupt));
+    std::remove(image.c_str());
+
+    std::cout << "All vocabulary image tests passed successfully! (open " << open_ms
+              << " ms, load " << load_ms << " ms)" << std::endl;
+}
+
+/**
+ * @brief Concatenates the pieces of tokens back into text.
+ */
+static std::string join_pieces(const SubwordTokenizer& subword, const std::vector<int32_t>& tokens) {
+    std::string text;
+    for (int32_t token : tokens) {
+        StringRef piece = subword.piece(token);
+        text.append(piece.data, piece.size);
+    }
+    return text;
+}
+
+void test_subword() {
+    Dictionary dict(16);
+    for (const char* word : {"un", "believ", "able", "unbeliev", "a", "b", "l", "e", "ab", "le", "ble", "able"})
+        dict.insert(word);
+    SubwordTokenizer subword(dict);
+    std::vector<int32_t> tokens;
+
+    // longest match first: "unbeliev" beats "un", then "able"
+    std::string text = "unbelievable";
+    subword.encode(text.data(), text.size(), tokens, SubwordTokenizer::WORDPIECE);
+    assert(tokens.size() == 2 && tokens[0] == dict.token("unbeliev") && tokens[1] == dict.token("able"));
+
+    // uncovered bytes fall back to byte tokens, so every word is fully covered
+    tokens.clear();
+    text = "x-able";
+    subword.encode(text.data(), text.size(), tokens, SubwordTokenizer::WORDPIECE);
+    assert(tokens.size() == 3 && tokens[0] == subword.byte_token('x') && tokens[1] == subword.byte_token('-'));
+    assert(join_pieces(subword, tokens) == text);
+
+    // BPE merges the lowest-token pair first: a+b -> ab (9) before l+e -> le (10), then ab+le -> able
+    tokens.clear();
+    text = "able";
+    subword.encode(text.data(), text.size(), tokens, SubwordTokenizer::BPE);
+    assert(tokens.size() == 1 && tokens[0] == dict.token("able"));
+    // without "ab" in the vocabulary the merges go b+le -> ble (11) after l+e, then a+ble
+    Dictionary no_ab(16);
+    for (const char* word : {"a", "b", "l", "e", "le", "ble", "able"})
+        no_ab.insert(word);
+    SubwordTokenizer no_ab_subword(no_ab);
+    tokens.clear();
+    text = "ablex";
+    no_ab_subword.encode(text.data(), text.size(), tokens, SubwordTokenizer::BPE);
+    assert(tokens.size() == 2 && tokens[0] == no_ab.token("able") && tokens[1] == no_ab_subword.byte_token('x'));
+
+    // a word of the vocabulary is its own token even when no pair of it merges
+    Dictionary words(16);
+    for (const char* word : {"t", "h", "e", "the", "then", "n"})
+        words.insert(word);
+    SubwordTokenizer words_subword(words);
+    tokens.clear();
+    text = "the then";
+    words_subword.encode(text.data(), text.size(), tokens, SubwordTokenizer::BPE);
+    assert(tokens.size() == 2 && tokens[0] == words.token("the") && tokens[1] == words.token("then"));
+    tokens.clear();
+    text = "thet";
+    words_subword.encode(text.data(), text.size(), tokens, SubwordTokenizer::BPE);
+    assert(tokens.size() == 4 && tokens[0] == words.token("t") && tokens[3] == words.token("t"));
+
+    // both modes cover arbitrary text, word by word
+    text = " unable,  believable\tl33t bleable ";
+    for (SubwordTokenizer::Mode mode : {SubwordTokenizer::WORDPIECE, SubwordTokenizer::BPE}) {
+        tokens.clear();
+        subword.encode(text.data(), text.size(), tokens, mode);
+        for (int32_t token : tokens)
+            assert(token > 0);
+        assert(join_pieces(subword, tokens) == "unable,believablel33tbleable");
+    }
+
+    std::cout << "All subword tests passed successfully!" << std::endl;
+}
+
+/**
+ * @brief Subword tokenization throughput against whole-word tokenize on the same text.
+ * @param filename Corpus used both for the vocabulary and as the text.
+ */
+void bench_subword(const std::string& filename) {
+    std::ifstream file(filename.c_str());
+    std::string text((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    Dictionary dict(1024);
+    assert(dict.load(filename));
+    SubwordTokenizer subword(dict);
+
+    using clock = std::chrono::steady_clock;
+    auto mb_per_s = [&text](clock::time_point start) {
+        return text.size() / std::chrono::duration<double>(clock::now() - start).count() / 1e6;
+    };
+    std::vector<int32_t> tokens;
+    tokens.reserve(text.size());
+    auto start = clock::now();
+    dict.tokenize(text.data(), text.size(), tokens);
+    double words_rate = mb_per_s(start);
+    std::size_t num_words = tokens.size();
+    tokens.clear();
+    start = clock::now();
+    subword.encode(text.data(), text.size(), tokens, SubwordTokenizer::WORDPIECE);
+    double wordpiece_rate = mb_per_s(start);
+    std::size_t num_wordpiece = tokens.size();
+    tokens.clear();
+    start = clock::now();
+    subword.encode(text.data(), text.size(), tokens, SubwordTokenizer::BPE);
+    double bpe_rate = mb_per_s(start);
+
+    std::cout << filename << " MB/s: words " << words_rate << " (" << num_words << " tokens), wordpiece "
+              << wordpiece_rate << " (" << num_wordpiece << "), bpe " << bpe_rate << " (" << tokens.size() << ")"
+              << std::endl;
+}
+
+// A 16-byte fixed key, e.g. a content digest
+struct Digest {
+    uint64_t lo;
+    uint64_t hi;
+};
+
+void test_fixed_key_table() {
+    // uint32_t keys against a reference map, through growth, churn and shrinking
+    HashTable<uint32_t, int> table;
+    std::unordered_map<uint32_t, int> reference;
+    std::mt19937 rng(250);
+    std::uniform_int_distribution<uint32_t> key(0, 5000);
+    for (int step = 0; step < 200000; step++) {
+        uint32_t k = key(rng);
+        if (step % 3 == 2) {
+            assert(table.remove(k) == (reference.erase(k) == 1));
+        } else {
+            assert(table.try_emplace(k, step) == reference.insert(std::make_pair(k, step)).second);
+        }
+    }
+    assert(table.get_size() == reference.size());
+    for (uint32_t k = 0; k <= 5000; k++) {
+        const int* value = table.find(k);
+        auto it = reference.find(k);
+        assert((value == nullptr) == (it == reference.end()));
+        assert(value == nullptr || *value == it->second);
+    }
+    for (uint32_t k = 0; k <= 5000; k++)
+        table.remove(k);
+    assert(table.get_size() == 0 && table.get_max_size() == 16);
+
+    // 16-byte keys
+    HashTable<Digest, uint32_t> digests{4};
+    for (uint64_t i = 0; i < 1000; i++)
+        assert(digests.insert(std::make_pair(Digest{i * 0x9E3779B97F4A7C15ULL, i}, static_cast<uint32_t>(i))));
+    assert(!digests.insert(std::make_pair(Digest{7 * 0x9E3779B97F4A7C15ULL, 7}, 0u)));
+    uint32_t value = 0;
+    assert(digests.try_get(Digest{7 * 0x9E3779B97F4A7C15ULL, 7}, value) && value == 7);
+    assert(!digests.try_get(Digest{7, 7}, value));
+    assert(digests.probe_length_histogram().size() < 64);
+
+    std::cout << "All fixed-key hash table tests passed successfully!" << std::endl;
+}
+
+/**
+ * @brief Compares uint32_t lookups in the inline-storage HashTable with std::unordered_map.
+ * @param num_keys Number of keys inserted and looked up.
+ */
+void bench_fixed_key_table(unsigned int num_keys) {
+    std::mt19937 rng(250);
+    std::vector<uint32_t> keys(num_keys);
+    for (auto& k : keys)
+        k = rng();
+    HashTable<uint32_t, int> table;
+    std::unordered_map<uint32_t, int> reference;
+    for (unsigned int i = 0; i < num_keys; i++) {
+        table.try_emplace(keys[i], i);
+        reference.insert(std::make_pair(keys[i], i));
+    }
+    std::shuffle(keys.begin(), keys.end(), rng);
+
+    using clock = std::chrono::steady_clock;
+    auto ns_per_op = [num_keys](clock::time_point start) {
+        return std::chrono::duration<double, std::nano>(clock::now() - start).count() / num_keys;
+    };
+    long checksum = 0;
+    auto start = clock::now();
+    for (uint32_t k : keys)
+        checksum += *table.find(k);
+    double table_ns = ns_per_op(start);
+    start = clock::now();
+    for (uint32_t k : keys)
+        checksum -= reference.find(k)->second;
+    double reference_ns = ns_per_op(start);
+
+    assert(checksum == 0);
+    std::cout << "uint32_t keys ns/lookup: HashTable " << table_ns << " unordered_map " << reference_ns << std::endl;
+}
+
+void test_stats() {
+    Dictionary dict(4);
+    for (unsigned int i = 0; i < 100; i++)
+        dict.insert(nth_word(i));
+    assert(dict.token("zz") == -1 && dict.token("ba") == -1 && dict.token("b") == 2);
+    assert(dict.remove("c"));
+
+    HashTableStats stats = dict.stats();
+    assert(stats.size == 99);
+    unsigned int buckets = 0;
+    for (unsigned int n : stats.chain_lengths)
+        buckets += n;
+    assert(buckets == stats.capacity && stats.bytes > 100);
+#ifdef HASHTABLE_STATS
+    // each insert looks its key up first, and so does remove
+    assert(stats.enabled);
+    assert(stats.inserts == 100 && stats.removes == 1 && stats.lookups == 104);
+    assert(stats.hits == 2 && stats.misses == 102 && stats.hits + stats.misses == stats.lookups);
+    assert(stats.resizes > 0 && stats.probes >= stats.hits);
+#else
+    assert(!stats.enabled && stats.lookups == 0 && stats.resizes == 0);
+#endif
+    std::string json = stats.to_json();
+    assert(json.front() == '{' && json.back() == '}');
+    assert(json.find("\"size\":99,") != std::string::npos);
+
+    std::cout << "All stats tests passed successfully!" << std::endl;
+}
@@ -1,145 +1,662 @@
 #include "tokenize.h"
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+#include <fstream>
+#include <new>
+#include <utility>
+#include <queue>
+#include <functional>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#ifdef HASHTABLE_STATS
+#include <chrono>
+#endif
+#include <sstream>
+
+/**
+ * @brief Maps the file at filename into memory.
+ * @param filename Path of the file to map.
+ * @return False if the file could not be opened or mapped.
+ */
+bool MappedFile::open(const std::string& filename) {
+    this->close();
+
+    int fd = ::open(filename.c_str(), O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // mmap rejects empty mappings, an empty file is simply an empty range
+    if (st.st_size > 0) {
+        void* addr = mmap(nullptr, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (addr == MAP_FAILED) {
+            ::close(fd);
+            return false;
+        }
+        madvise(addr, st.st_size, MADV_SEQUENTIAL);
+        this->data_ = static_cast<const char*>(addr);
+        this->size_ = st.st_size;
+    }
+    ::close(fd);
+    return true;
+}
+
+/**
+ * @brief Unmaps the file, if any.
+ */
+void MappedFile::close() {
+    if (this->data_ != nullptr)
+        munmap(const_cast<char*>(this->data_), this->size_);
+    this->data_ = nullptr;
+    this->size_ = 0;
+}
 
 /**
  * @brief Constructor for KeyError exception class.
  * @param key The key that caused the error.
  */
-KeyError::KeyError(const std::string& key) : key_(key) {
-    error_msg = "KeyError: " + key_;
-}
+KeyError::KeyError(const std::string& key) : key_(key) {}
 
 /**
- * @brief Returns the error message as a C-style string.
+ * @brief Returns the error message as a C-style string, building it on the first call.
  * @return The error message.
  */
 const char* KeyError::what() const noexcept {
+    if (error_msg.empty()) {
+        try {
+            error_msg = "KeyError: " + key_;
+        } catch (...) {
+            return "KeyError";
+        }
+    }
     return error_msg.c_str();
 }
 
 /**
- * @brief Hash function to calculate the index for a given string key.
- * @param str The string key to hash.
- * @return The hashed index.
+ * @brief The assignment's polynomial string hash.
+ * Kept in 32-bit unsigned arithmetic so the bucket of every key matches the spec.
+ * @param str The first character of the key.
+ * @param len The number of characters.
+ * @return The hash, before reduction modulo the capacity.
  */
-template <typename value_t>
-unsigned int HashTable<std::string, value_t>::hash(const std::string &str) const {
+uint64_t PolynomialHash::hash(const char* str, std::size_t len) {
     unsigned int ans = 0;
-    for (auto it = str.begin(); it != str.end(); ++it)
+    for (const char* it = str; it != str + len; ++it)
         ans = ans * 29 + *it;
-    return ans % this->capacity;
+    return ans;
 }
 
+namespace {
+
+const uint64_t WY_SECRET[4] = {0xa0761d6478bd642fULL, 0xe7037ed1a0b428dbULL,
+                               0x8ebc6af09c88c6e3ULL, 0x589965cc75374cc3ULL};
+
 /**
- * @brief Doubles the size of the hash table and rehashes all elements.
+ * @brief Multiplies two 64-bit words and folds the 128-bit product back into 64 bits.
  */
-template <typename value_t>
-void HashTable<std::string, value_t>::double_size() {
-    this->capacity *= 2;
-    auto new_array = new std::forward_list<ht_pair>[this->capacity];
-    for (unsigned int i = 0; i < this->capacity / 2; i++) {
-        for (auto item : this->array[i]) {
-            auto new_hash_int = hash(item.first);
-            new_array[new_hash_int].push_front(item);
+inline uint64_t wy_mix(uint64_t a, uint64_t b) {
+    __uint128_t r = static_cast<__uint128_t>(a) * b;
+    return static_cast<uint64_t>(r) ^ static_cast<uint64_t>(r >> 64);
+}
+
+inline uint64_t wy_read8(const char* p) {
+    uint64_t v;
+    std::memcpy(&v, p, 8);
+    return v;
+}
+
+inline uint64_t wy_read4(const char* p) {
+    uint32_t v;
+    std::memcpy(&v, p, 4);
+    return v;
+}
+
+} // namespace
+
+/**
+ * @brief wyhash-style 64-bit string hash.
+ * Keys up to 16 bytes are read as (possibly overlapping) 4- or 8-byte words, longer keys
+ * are folded 16 bytes at a time, and the last two words are mixed with the length.
+ * @param str The first character of the key.
+ * @param len The number of characters.
+ * @return The 64-bit hash.
+ */
+uint64_t WyHash::hash(const char* str, std::size_t len) {
+    uint64_t seed = WY_SECRET[0];
+    uint64_t a, b;
+    if (len <= 16) {
+        if (len >= 4) {
+            const std::size_t mid = (len >> 3) << 2;
+            a = (wy_read4(str) << 32) | wy_read4(str + mid);
+            b = (wy_read4(str + len - 4) << 32) | wy_read4(str + len - 4 - mid);
+        } else if (len > 0) {
+            a = (static_cast<uint64_t>(static_cast<unsigned char>(str[0])) << 16)
+                | (static_cast<uint64_t>(static_cast<unsigned char>(str[len >> 1])) << 8)
+                | static_cast<unsigned char>(str[len - 1]);
+            b = 0;
+        } else {
+            a = b = 0;
+        }
+    } else {
+        std::size_t i = len;
+        const char* p = str;
+        while (i > 16) {
+            seed = wy_mix(wy_read8(p) ^ WY_SECRET[1], wy_read8(p + 8) ^ seed);
+            p += 16;
+            i -= 16;
+        }
+        a = wy_read8(p + i - 16);
+        b = wy_read8(p + i - 8);
+    }
+    return wy_mix(WY_SECRET[1] ^ len, wy_mix(a ^ WY_SECRET[1], b ^ seed));
+}
+
+#ifdef HASHTABLE_STATS
+/**
+ * @brief Copies the counters into a snapshot.
+ * @param stats Receives the counter values and enabled = true.
+ */
+void HashTableCounters::fill(HashTableStats& stats) const {
+    stats.enabled = true;
+    stats.lookups = this->lookups.load(std::memory_order_relaxed);
+    stats.hits = this->hits.load(std::memory_order_relaxed);
+    stats.misses = this->misses.load(std::memory_order_relaxed);
+    stats.probes = this->probes.load(std::memory_order_relaxed);
+    stats.inserts = this->inserts.load(std::memory_order_relaxed);
+    stats.removes = this->removes.load(std::memory_order_relaxed);
+    stats.resizes = this->resizes.load(std::memory_order_relaxed);
+    stats.resize_ms = this->resize_ns.load(std::memory_order_relaxed) / 1e6;
+}
+#endif
+
+/**
+ * @brief Formats the snapshot as a single JSON object.
+ * @return The JSON text, without a trailing newline.
+ */
+std::string HashTableStats::to_json() const {
+    std::ostringstream out;
+    out << "{\"enabled\":" << (this->enabled ? "true" : "false")
+        << ",\"lookups\":" << this->lookups
+        << ",\"hits\":" << this->hits
+        << ",\"misses\":" << this->misses
+        << ",\"probes\":" << this->probes
+        << ",\"inserts\":" << this->inserts
+        << ",\"removes\":" << this->removes
+        << ",\"resizes\":" << this->resizes
+        << ",\"resize_ms\":" << this->resize_ms
+        << ",\"size\":" << this->size
+        << ",\"capacity\":" << this->capacity
+        << ",\"bytes\":" << this->bytes
+        << ",\"chain_lengths\":[";
+    for (std::size_t i = 0; i < this->chain_lengths.size(); i++)
+        out << (i > 0 ? "," : "") << this->chain_lengths[i];
+    out << "]}";
+    return out.str();
+}
+
+/**
+ * @brief Prints the snapshot one "name value" line at a time.
+ * @param out The stream to print to.
+ */
+void HashTableStats::print(std::ostream& out) const {
+    if (this->enabled) {
+        out << "lookups " << this->lookups << std::endl;
+        out << "hits " << this->hits << std::endl;
+        out << "misses " << this->misses << std::endl;
+        out << "probes/lookup " << (this->lookups > 0 ? static_cast<double>(this->probes) / this->lookups : 0) << std::endl;
+        out << "inserts " << this->inserts << std::endl;
+        out << "removes " << this->removes << std::endl;
+        out << "resizes " << this->resizes << " (" << this->resize_ms << " ms)" << std::endl;
+    } else {
+        out << "counters disabled (build with -DHASHTABLE_STATS)" << std::endl;
+    }
+    out << "size " << this->size << std::endl;
+    out << "capacity " << this->capacity << std::endl;
+    out << "bytes " << this->bytes << std::endl;
+    out << "chain lengths";
+    for (unsigned int n : this->chain_lengths)
+        out << " " << n;
+    out << std::endl;
+}
+
+/**
+ * @brief Allocates a bucket array without constructing its buckets. Large arrays come
+ * from fresh pages, so the allocation itself costs the same whatever the size.
+ */
+template <typename value_t, typename hash_t, typename keys_t>
+std::forward_list<typename ChainedHashTable<value_t, hash_t, keys_t>::ht_pair>*
+ChainedHashTable<value_t, hash_t, keys_t>::allocate_buckets(unsigned int num_buckets) {
+    return static_cast<chain_t*>(::operator new(static_cast<std::size_t>(num_buckets) * sizeof(chain_t)));
+}
+
+/**
+ * @brief Destroys buckets [first, last) of an array, the only ones still constructed,
+ * and frees the array.
+ */
+template <typename value_t, typename hash_t, typename keys_t>
+void ChainedHashTable<value_t, hash_t, keys_t>::free_buckets(std::forward_list<ht_pair>* buckets, unsigned int first,
+                                                             unsigned int last) {
+    if (buckets == nullptr)
+        return;
+    for (unsigned int i = first; i < last; i++)
+        buckets[i].~chain_t();
+    ::operator delete(buckets);
+}
+
+/**
+ * @brief Constructs up to num_buckets more buckets of the array the next incremental
+ * doubling will switch to, allocating it first if needed.
+ */
+template <typename value_t, typename hash_t, typename keys_t>
+void ChainedHashTable<value_t, hash_t, keys_t>::build_step(unsigned int num_buckets) {
+    if (this->next_array == nullptr) {
+        this->next_array = allocate_buckets(2 * this->capacity);
+        this->next_built = 0;
+    }
+    for (; num_buckets > 0 && this->next_built < 2 * this->capacity; num_buckets--)
+        new (&this->next_array[this->next_built++]) chain_t();
+}
+
+/**
+ * @brief Constructor for the chained table.
+ * @param size The initial number of buckets, as adjusted by the hash policy.
+ */
+template <typename value_t, typename hash_t, typename keys_t>
+ChainedHashTable<value_t, hash_t, keys_t>::ChainedHashTable(const unsigned int size)
+    : curr_size{0}, capacity{hash_t::capacity_for(size)}, min_capacity{capacity} {
+    this->array = allocate_buckets(this->capacity);
+    for (unsigned int i = 0; i < this->capacity; i++)
+        new (&this->array[i]) chain_t();
+}
+
+/**
+ * @brief Destructor for the chained table. Key storage outside the nodes is left alone.
+ */
+template <typename value_t, typename hash_t, typename keys_t>
+ChainedHashTable<value_t, hash_t, keys_t>::~ChainedHashTable() {
+    free_buckets(this->array, 0, this->capacity);
+    free_buckets(this->old_array, this->rehash_index, this->old_capacity);
+    free_buckets(this->next_array, 0, this->next_built);
+}
+
+/**
+ * @brief Bucket of a stored key in an array of num_buckets buckets.
+ */
+template <typename value_t, typename hash_t, typename keys_t>
+unsigned int ChainedHashTable<value_t, hash_t, keys_t>::bucket_of(const key_type& key, unsigned int num_buckets) const {
+    const StringRef bytes = this->keys.bytes(key);
+    return hash_t::index(hash_t::hash(bytes.data, bytes.size), num_buckets);
+}
+
+/**
+ * @brief Compares the characters of a stored key with a character range.
+ */
+template <typename value_t, typename hash_t, typename keys_t>
+bool ChainedHashTable<value_t, hash_t, keys_t>::matches(const ht_pair& item, const char* key, std::size_t len) const {
+    const StringRef bytes = this->keys.bytes(item.first);
+    return bytes.size == len && std::memcmp(bytes.data, key, len) == 0;
+}
+
+/**
+ * @brief Checks that a key only holds letters.
+ */
+template <typename value_t, typename hash_t, typename keys_t>
+bool ChainedHashTable<value_t, hash_t, keys_t>::valid_key(const char* str, std::size_t len) {
+    for (std::size_t i = 0; i < len; i++) {
+        if (!std::isalpha(str[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+/**
+ * @brief Advances a pending incremental resize, then checks that the key may be inserted.
+ * @param h The hash_key() of the key.
+ * @return True if the key is valid and absent.
+ */
+template <typename value_t, typename hash_t, typename keys_t>
+bool ChainedHashTable<value_t, hash_t, keys_t>::admits(const char* key, std::size_t len, uint64_t h) {
+    if (this->old_array != nullptr)
+        rehash_step(REHASH_STEP);
+    if (this->incremental)
+        build_step(BUILD_STEP);
+    return valid_key(key, len) && find(key, len, h) == nullptr;
+}
+
+/**
+ * @brief Links a new pair at the front of its chain and grows the table if needed.
+ * @param h The hash_key() of the key.
+ * @param key The stored key.
+ * @param value The value to associate with the key.
+ */
+template <typename value_t, typename hash_t, typename keys_t>
+void ChainedHashTable<value_t, hash_t, keys_t>::link(uint64_t h, key_type&& key, const value_t& value) {
+    this->array[hash_t::index(h, this->capacity)].emplace_front(std::move(key), value);
+    this->curr_size++;
+    HASHTABLE_COUNT(inserts, 1);
+
+    if (this->load_factor() >= threshold) {
+        if (this->incremental)
+            start_rehash();
+        else
+            resize(this->capacity * 2);
+    }
+}
+
+/**
+ * @brief Moves every pair into a new bucket array of new_capacity buckets.
+ * Nodes are spliced from the old chains into the new ones, so no pair is copied or reallocated.
+ * @param new_capacity The number of buckets of the new array.
+ */
+template <typename value_t, typename hash_t, typename keys_t>
+void ChainedHashTable<value_t, hash_t, keys_t>::resize(unsigned int new_capacity) {
+#ifdef HASHTABLE_STATS
+    const auto start = std::chrono::steady_clock::now();
+#endif
+    const unsigned int old_capacity = this->capacity;
+    this->capacity = new_capacity;
+    auto new_array = allocate_buckets(this->capacity);
+    for (unsigned int i = 0; i < this->capacity; i++)
+        new (&new_array[i]) chain_t();
+    for (unsigned int i = 0; i < old_capacity; i++) {
+        auto& old_chain = this->array[i];
+        while (!old_chain.empty()) {
+            auto& new_chain = new_array[bucket_of(old_chain.front().first, this->capacity)];
+            new_chain.splice_after(new_chain.before_begin(), old_chain, old_chain.before_begin());
         }
     }
-    delete[] this->array;
+    free_buckets(this->array, 0, old_capacity);
     this->array = new_array;
+    // an array prepared for doubling the old capacity does not fit the new one
+    free_buckets(this->next_array, 0, this->next_built);
+    this->next_array = nullptr;
+#ifdef HASHTABLE_STATS
+    HASHTABLE_COUNT(resizes, 1);
+    HASHTABLE_COUNT(resize_ns, std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now() - start).count());
+#endif
+}
+
+/**
+ * @brief Starts an incremental resize: the current array becomes the old one and
+ * inserts go to the prepared array of twice the size from now on.
+ */
+template <typename value_t, typename hash_t, typename keys_t>
+void ChainedHashTable<value_t, hash_t, keys_t>::start_rehash() {
+    // a previous migration must be complete before the old array can be replaced
+    if (this->old_array != nullptr)
+        rehash_step(this->old_capacity);
+    // normally build_step has constructed the whole next array by now
+    build_step(2 * this->capacity);
+
+    this->old_array = this->array;
+    this->old_capacity = this->capacity;
+    this->rehash_index = 0;
+    this->capacity *= 2;
+    this->array = this->next_array;
+    this->next_array = nullptr;
+    // the migration itself is spread over later inserts and not timed
+    HASHTABLE_COUNT(resizes, 1);
+}
+
+/**
+ * @brief Moves up to num_buckets non-empty old buckets into the new array, destroying
+ * each old bucket once it is empty. At most 10 empty buckets are skipped per non-empty
+ * one, which bounds the work of a single call even on a sparse old array.
+ * @param num_buckets The number of non-empty buckets to migrate.
+ */
+template <typename value_t, typename hash_t, typename keys_t>
+void ChainedHashTable<value_t, hash_t, keys_t>::rehash_step(unsigned int num_buckets) {
+    unsigned int empty_visits = num_buckets * 10;
+    while (num_buckets > 0 && this->rehash_index < this->old_capacity) {
+        auto& old_chain = this->old_array[this->rehash_index];
+        if (old_chain.empty()) {
+            old_chain.~chain_t();
+            this->rehash_index++;
+            if (--empty_visits == 0)
+                break;
+            continue;
+        }
+        while (!old_chain.empty()) {
+            auto& new_chain = this->array[bucket_of(old_chain.front().first, this->capacity)];
+            new_chain.splice_after(new_chain.before_begin(), old_chain, old_chain.before_begin());
+        }
+        old_chain.~chain_t();
+        this->rehash_index++;
+        num_buckets--;
+    }
+
+    if (this->rehash_index == this->old_capacity) {
+        free_buckets(this->old_array, this->old_capacity, this->old_capacity);
+        this->old_array = nullptr;
+        this->old_capacity = 0;
+    }
+}
+
+/**
+ * @brief Switches between synchronous and incremental resizing.
+ * @param on True for incremental resizing, false for the default synchronous doubling.
+ */
+template <typename value_t, typename hash_t, typename keys_t>
+void ChainedHashTable<value_t, hash_t, keys_t>::set_incremental(bool on) {
+    if (!on && this->old_array != nullptr)
+        rehash_step(this->old_capacity);
+    this->incremental = on;
+}
+
+/**
+ * @brief Whether an incremental resize is still migrating buckets.
+ */
+template <typename value_t, typename hash_t, typename keys_t>
+bool ChainedHashTable<value_t, hash_t, keys_t>::is_rehashing() const {
+    return this->old_array != nullptr;
+}
+
+/**
+ * @brief Distribution of chain lengths over all buckets.
+ * Buckets of the old array that are still waiting for an incremental migration are included.
+ * @return histogram[n] is the number of buckets holding exactly n pairs.
+ */
+template <typename value_t, typename hash_t, typename keys_t>
+std::vector<unsigned int> ChainedHashTable<value_t, hash_t, keys_t>::chain_length_histogram() const {
+    std::vector<unsigned int> histogram;
+    auto count = [&histogram](const std::forward_list<ht_pair>& chain) {
+        std::size_t length = std::distance(chain.begin(), chain.end());
+        if (histogram.size() <= length)
+            histogram.resize(length + 1, 0);
+        histogram[length]++;
+    };
+    for (unsigned int i = 0; i < this->capacity; i++)
+        count(this->array[i]);
+    for (unsigned int i = this->rehash_index; this->old_array != nullptr && i < this->old_capacity; i++)
+        count(this->old_array[i]);
+    return histogram;
+}
+
+/**
+ * @brief Counters and layout of the table. Bytes count both bucket arrays during an
+ * incremental resize, and whatever heap memory the stored keys hold (keys_t::heap_bytes).
+ * @return The snapshot.
+ */
+template <typename value_t, typename hash_t, typename keys_t>
+HashTableStats ChainedHashTable<value_t, hash_t, keys_t>::stats() const {
+    HashTableStats stats;
+#ifdef HASHTABLE_STATS
+    this->counters.fill(stats);
+#endif
+    stats.size = this->curr_size;
+    stats.capacity = this->capacity;
+    stats.chain_lengths = this->chain_length_histogram();
+
+    const unsigned int buckets = this->capacity + (this->old_array != nullptr ? this->old_capacity : 0);
+    stats.bytes = static_cast<uint64_t>(buckets) * sizeof(std::forward_list<ht_pair>)
+                  + static_cast<uint64_t>(this->curr_size) * (sizeof(ht_pair) + sizeof(void*));
+    auto key_bytes = [this, &stats](const std::forward_list<ht_pair>& chain) {
+        for (const auto& item : chain)
+            stats.bytes += this->keys.heap_bytes(item.first);
+    };
+    for (unsigned int i = 0; i < this->capacity; i++)
+        key_bytes(this->array[i]);
+    for (unsigned int i = this->rehash_index; this->old_array != nullptr && i < this->old_capacity; i++)
+        key_bytes(this->old_array[i]);
+    return stats;
 }
 
 /**
  * @brief Calculates the load factor of the hash table.
  * @return The load factor.
  */
-template <typename value_t>
-inline double HashTable<std::string, value_t>::load_factor() const {
+template <typename value_t, typename hash_t, typename keys_t>
+inline double ChainedHashTable<value_t, hash_t, keys_t>::load_factor() const {
     return static_cast<double>(this->curr_size) / this->capacity;
 }
 
 /**
- * @brief Constructor for HashTable class.
- * @param size The initial size of the hash table.
+ * @brief Inserts (key, value) only if the key is absent.
+ * @param key The first character of the key.
+ * @param len The number of characters of the key.
+ * @param value The value to store.
+ * @return True if the pair was inserted, false if the key exists or is invalid.
  */
-template <typename value_t>
-HashTable<std::string, value_t>::HashTable(const unsigned int size) : curr_size{0}, capacity{size} {
-    array = new std::forward_list<ht_pair>[size];
+template <typename value_t, typename hash_t, typename keys_t>
+bool ChainedHashTable<value_t, hash_t, keys_t>::try_emplace(const char* key, std::size_t len, const value_t& value) {
+    const uint64_t h = hash_t::hash(key, len);
+    if (!admits(key, len, h))
+        return false;
+    link(h, this->keys.store(key, len), value);
+    return true;
 }
 
 /**
- * @brief Destructor for HashTable class.
+ * @brief Looks up a key given as a character range, without building a std::string.
+ * @param key The first character of the key.
+ * @param len The number of characters of the key.
+ * @return A pointer to the stored value, or nullptr if the key is absent.
  */
-template <typename value_t>
-HashTable<std::string, value_t>::~HashTable() {
-    delete[] array;
+template <typename value_t, typename hash_t, typename keys_t>
+const value_t* ChainedHashTable<value_t, hash_t, keys_t>::find(const char* key, std::size_t len) const {
+    return find(key, len, hash_t::hash(key, len));
 }
 
 /**
- * @brief Inserts a key-value pair into the hash table.
- * @param pair The key-value pair to insert.
- * @return True if insertion is successful, false if the key already exists or is invalid.
+ * @brief Looks up a key whose hash is already known.
+ * @param h The hash_key() of the key.
  */
-template <typename value_t>
-bool HashTable<std::string, value_t>::insert(const ht_pair& pair) {
-    for (auto c : pair.first) {
-        if (!std::isalpha(c)) {
-            return false;
+template <typename value_t, typename hash_t, typename keys_t>
+const value_t* ChainedHashTable<value_t, hash_t, keys_t>::find(const char* key, std::size_t len, uint64_t h) const {
+    HASHTABLE_COUNT(lookups, 1);
+    for (const auto& item : this->array[hash_t::index(h, this->capacity)]) {
+        HASHTABLE_COUNT(probes, 1);
+        if (matches(item, key, len)) {
+            HASHTABLE_COUNT(hits, 1);
+            return &item.second;
         }
     }
-    auto hash_int = hash(pair.first);
-    auto& this_list = this->array[hash_int];
-    if (this_list.empty()) {
-        this_list.push_front(pair);
-    } else {
-        for (auto item : this_list) {
-            if (item.first == pair.first) {
-                return false;
+    // during an incremental resize the key may still sit in an unmigrated old bucket
+    if (this->old_array != nullptr && hash_t::index(h, this->old_capacity) >= this->rehash_index) {
+        for (const auto& item : this->old_array[hash_t::index(h, this->old_capacity)]) {
+            HASHTABLE_COUNT(probes, 1);
+            if (matches(item, key, len)) {
+                HASHTABLE_COUNT(hits, 1);
+                return &item.second;
             }
         }
-        this_list.push_front(pair);
     }
-    this->curr_size++;
+    HASHTABLE_COUNT(misses, 1);
+    return nullptr;
+}
 
-    if (this->load_factor() >= threshold) {
-        double_size();
-    }
-    
+/**
+ * @brief Copies the value of a key into value if the key is present.
+ * @param key The first character of the key.
+ * @param len The number of characters of the key.
+ * @param value Receives the value when the key is found.
+ * @return True if the key was found.
+ */
+template <typename value_t, typename hash_t, typename keys_t>
+bool ChainedHashTable<value_t, hash_t, keys_t>::try_get(const char* key, std::size_t len, value_t& value) const {
+    const value_t* found = find(key, len);
+    if (found == nullptr)
+        return false;
+    value = *found;
     return true;
 }
 
 /**
- * @brief Retrieves the value associated with a given string key.
- * @param word The string key to search for.
- * @return The value associated with the key.
- * @throws KeyError if the key is not found in the hash table.
+ * @brief Removes a key from the hash table and releases its stored key.
+ * @param key The first character of the key.
+ * @param len The number of characters of the key.
+ * @return True if the key was present and removed, false otherwise.
  */
-template <typename value_t>
-value_t HashTable<std::string, value_t>::get(const std::string& word) const {
-    auto hash_int = hash(word);
-    if (!array[hash_int].empty()) {
-        for (auto item : array[hash_int]) {
-            if (item.first == word) {
-                return item.second;
+template <typename value_t, typename hash_t, typename keys_t>
+bool ChainedHashTable<value_t, hash_t, keys_t>::remove(const char* key, std::size_t len) {
+    auto unlink = [this, key, len](std::forward_list<ht_pair>& chain) -> bool {
+        for (auto prev = chain.before_begin(), it = chain.begin(); it != chain.end(); prev = it++) {
+            if (matches(*it, key, len)) {
+                this->keys.release(it->first);
+                chain.erase_after(prev);
+                return true;
             }
         }
-    }
-    throw KeyError(word);
+        return false;
+    };
+
+    const uint64_t h = hash_t::hash(key, len);
+    bool removed = unlink(this->array[hash_t::index(h, this->capacity)]);
+    if (!removed && this->old_array != nullptr && hash_t::index(h, this->old_capacity) >= this->rehash_index)
+        removed = unlink(this->old_array[hash_t::index(h, this->old_capacity)]);
+    if (!removed)
+        return false;
+
+    this->curr_size--;
+    HASHTABLE_COUNT(removes, 1);
+    shrink();
+    return true;
 }
 
 /**
- * @brief Retrieves the value associated with a given string key using the [] operator.
- * @param word The string key to search for.
- * @return The value associated with the key.
+ * @brief Shrinks the bucket array once the load factor is far below the threshold.
+ * Shrinking to a load of threshold / 2 rather than just under threshold leaves room for
+ * the table to grow again before the next doubling, so alternating inserts and removals
+ * around one size cannot make it resize back and forth.
+ * @return True if the table was resized.
  */
-template <typename value_t>
-value_t HashTable<std::string, value_t>::operator[](const std::string& word) const {
-    return get(word);
+template <typename value_t, typename hash_t, typename keys_t>
+bool ChainedHashTable<value_t, hash_t, keys_t>::shrink() {
+    if (this->load_factor() >= threshold / 4)
+        return false;
+    unsigned int new_capacity = this->capacity;
+    while (new_capacity / 2 >= this->min_capacity && new_capacity / 2 > 0
+           && this->curr_size < threshold / 2 * (new_capacity / 2))
+        new_capacity /= 2;
+    if (new_capacity == this->capacity)
+        return false;
+
+    // the old array of an incremental resize is finished first so only one array is resized
+    if (this->old_array != nullptr)
+        rehash_step(this->old_capacity);
+    resize(new_capacity);
+    return true;
 }
 
 /**
  * @brief Returns the current size of the hash table.
  * @return The current size.
  */
-template <typename value_t>
-unsigned int HashTable<std::string, value_t>::get_size() const {
+template <typename value_t, typename hash_t, typename keys_t>
+unsigned int ChainedHashTable<value_t, hash_t, keys_t>::get_size() const {
     return this->curr_size;
 }
 
@@ -147,8 +664,8 @@ unsigned int HashTable<std::string, value_t>::get_size() const {
  * @brief Returns the maximum size (capacity) of the hash table.
  * @return The maximum size.
  */
-template <typename value_t>
-unsigned int HashTable<std::string, value_t>::get_max_size() const {
+template <typename value_t, typename hash_t, typename keys_t>
+unsigned int ChainedHashTable<value_t, hash_t, keys_t>::get_max_size() const {
     return this->capacity;
 }
 
@@ -156,80 +673,1421 @@ unsigned int HashTable<std::string, value_t>::get_max_size() const {
  * @brief Prints the keys in the chain at a specific hash table position.
  * @param k The position in the hash table.
  */
-template <typename value_t>
-void HashTable<std::string, value_t>::print(unsigned int k) const {
-    if (k < 0 || k >= this->capacity) {
+template <typename value_t, typename hash_t, typename keys_t>
+void ChainedHashTable<value_t, hash_t, keys_t>::print(unsigned int k) const {
+    if (k >= this->capacity || this->array[k].empty())
         return;
+    for (const auto& item : this->array[k]) {
+        const StringRef bytes = this->keys.bytes(item.first);
+        std::cout.write(bytes.data, bytes.size);
+        std::cout << " ";
     }
-    if (!this->array[k].empty()) {
-        for (auto item : array[k]) {
-            std::cout << item.first << " ";
+    std::cout << std::endl;
+}
+
+/**
+ * @brief Prints the size, capacity and every non-empty chain, each line starting with prefix.
+ * Chains of the old array of an incremental resize that are not migrated yet are listed as old[i].
+ * @param prefix Text printed at the start of every line.
+ */
+template <typename value_t, typename hash_t, typename keys_t>
+void ChainedHashTable<value_t, hash_t, keys_t>::debug_print(std::string prefix) const {
+    std::cout << prefix << "size " << this->curr_size << " capacity " << this->capacity
+              << " load " << this->load_factor() << std::endl;
+    auto print_chain = [this](const std::forward_list<ht_pair>& chain) {
+        for (const auto& item : chain) {
+            const StringRef bytes = this->keys.bytes(item.first);
+            std::cout << " ";
+            std::cout.write(bytes.data, bytes.size);
+            std::cout << "=" << item.second;
         }
         std::cout << std::endl;
+    };
+    for (unsigned int i = 0; i < this->capacity; i++) {
+        if (this->array[i].empty())
+            continue;
+        std::cout << prefix << "[" << i << "]";
+        print_chain(this->array[i]);
+    }
+    for (unsigned int i = this->rehash_index; this->old_array != nullptr && i < this->old_capacity; i++) {
+        if (this->old_array[i].empty())
+            continue;
+        std::cout << prefix << "old[" << i << "]";
+        print_chain(this->old_array[i]);
     }
 }
 
-// Instantiate the template
-template class HashTable<std::string, int>;
+/**
+ * @brief Constructor for HashTable class.
+ * @param size The initial size of the hash table.
+ */
+template <typename value_t, typename hash_t>
+HashTable<std::string, value_t, hash_t>::HashTable(const unsigned int size) : base_t(size) {}
 
 /**
- * @brief Constructor for Dictionary class.
- * @param size The initial size of the dictionary.
+ * @brief Inserts a key-value pair into the hash table.
+ * @param pair The key-value pair to insert.
+ * @return True if insertion is successful, false if the key already exists or is invalid.
  */
-Dictionary::Dictionary(unsigned int size) : hash_table(size) {
-    words.reserve(size);
-    words.push_back("");
+template <typename value_t, typename hash_t>
+bool HashTable<std::string, value_t, hash_t>::insert(const ht_pair& pair) {
+    return this->try_emplace(pair.first.data(), pair.first.size(), pair.second);
 }
 
 /**
- * @brief Inserts a word into the dictionary.
- * @param str The word to insert.
- * @return True if insertion is successful, false otherwise.
+ * @brief Inserts a key-value pair, moving the key into the table instead of copying it.
+ * @param pair The key-value pair to insert.
+ * @return True if insertion is successful, false if the key already exists or is invalid.
  */
-bool Dictionary::insert(const std::string & str) {
-    unsigned int token = this->words.size();
-    bool _inserted = this->hash_table.insert({str, token});
-    if (!_inserted)
+template <typename value_t, typename hash_t>
+bool HashTable<std::string, value_t, hash_t>::insert(ht_pair&& pair) {
+    const uint64_t h = hash_t::hash(pair.first.data(), pair.first.size());
+    if (!this->admits(pair.first.data(), pair.first.size(), h))
         return false;
-    this->words.push_back(str);
+    this->link(h, std::move(pair.first), pair.second);
     return true;
 }
 
+template <typename value_t, typename hash_t>
+bool HashTable<std::string, value_t, hash_t>::try_emplace(const std::string& key, const value_t& value) {
+    return this->try_emplace(key.data(), key.size(), value);
+}
+
+template <typename value_t, typename hash_t>
+const value_t* HashTable<std::string, value_t, hash_t>::find(const std::string& key) const {
+    return this->find(key.data(), key.size());
+}
+
+template <typename value_t, typename hash_t>
+bool HashTable<std::string, value_t, hash_t>::try_get(const std::string& key, value_t& value) const {
+    return this->try_get(key.data(), key.size(), value);
+}
+
+template <typename value_t, typename hash_t>
+bool HashTable<std::string, value_t, hash_t>::remove(const std::string& word) {
+    return this->remove(word.data(), word.size());
+}
+
 /**
- * @brief Retrieves the numeric token associated with a word.
- * @param word The word to search for.
- * @return The numeric token if the word exists, -1 otherwise.
+ * @brief Retrieves the value associated with a given string key.
+ * @param word The string key to search for.
+ * @return The value associated with the key.
+ * @throws KeyError if the key is not found in the hash table.
  */
-int Dictionary::token(const std::string& word) {
-    try {
-        return this->hash_table.get(word);
-    } catch (const KeyError& e) {
-        return -1;
-    }    
+template <typename value_t, typename hash_t>
+value_t HashTable<std::string, value_t, hash_t>::get(const std::string& word) const {
+    const value_t* value = find(word);
+    if (value == nullptr)
+        throw KeyError(word);
+    return *value;
 }
 
 /**
- * @brief Retrieves the word associated with a numeric token.
- * @param token The numeric token to search for.
- * @return The word if the token exists, "N/A" otherwise.
+ * @brief Retrieves the value associated with a given string key using the [] operator.
+ * @param word The string key to search for.
+ * @return The value associated with the key.
  */
-std::string Dictionary::ret(const int& token) {
-    if (token < 1 || token >= this->words.size()) {
-        return std::string("N/A");
+template <typename value_t, typename hash_t>
+value_t HashTable<std::string, value_t, hash_t>::operator[](const std::string& word) const {
+    return get(word);
+}
+
+// Instantiate the template
+template class ChainedHashTable<int, PolynomialHash, StringKeys>;
+template class ChainedHashTable<int, WyHash, StringKeys>;
+template class HashTable<std::string, int, PolynomialHash>;
+template class HashTable<std::string, int, WyHash>;
+
+namespace {
+
+/**
+ * @brief Matches 16 control bytes against c.
+ * @param ctrl The first of the 16 control bytes.
+ * @param c The control byte to look for.
+ * @return A mask with bit i set when ctrl[i] == c.
+ */
+inline uint32_t group_match(const int8_t* ctrl, int8_t c) {
+#if defined(__SSE2__)
+    __m128i group = _mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_set1_epi8(c), group));
+#else
+    uint32_t mask = 0;
+    for (unsigned int i = 0; i < 16; i++)
+        mask |= static_cast<uint32_t>(ctrl[i] == c) << i;
+    return mask;
+#endif
+}
+
+/**
+ * @brief Matches 16 control bytes against the EMPTY and DELETED markers, the only negative ones.
+ * @param ctrl The first of the 16 control bytes.
+ * @return A mask with bit i set when slot i is free.
+ */
+inline uint32_t group_match_free(const int8_t* ctrl) {
+#if defined(__SSE2__)
+    return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(ctrl)));
+#else
+    uint32_t mask = 0;
+    for (unsigned int i = 0; i < 16; i++)
+        mask |= static_cast<uint32_t>(ctrl[i] < 0) << i;
+    return mask;
+#endif
+}
+
+} // namespace
+
+template <typename value_t, typename hash_t>
+const unsigned int FlatHashTable<std::string, value_t, hash_t>::GROUP_WIDTH;
+template <typename value_t, typename hash_t>
+const int8_t FlatHashTable<std::string, value_t, hash_t>::EMPTY;
+template <typename value_t, typename hash_t>
+const int8_t FlatHashTable<std::string, value_t, hash_t>::DELETED;
+
+/**
+ * @brief Hash function for the flat table.
+ * The low 7 bits go into the control byte and the rest picks the start of the probe,
+ * so the policy must mix both halves well (WyHash does, PolynomialHash does not).
+ * @param str The string key to hash.
+ * @return The full 64-bit hash.
+ */
+template <typename value_t, typename hash_t>
+uint64_t FlatHashTable<std::string, value_t, hash_t>::hash(const std::string &str) const {
+    return hash_t::hash(str.data(), str.size());
+}
+
+/**
+ * @brief Writes control byte i, keeping the mirrored copy of the first group in sync.
+ */
+template <typename value_t, typename hash_t>
+void FlatHashTable<std::string, value_t, hash_t>::set_ctrl(unsigned int i, int8_t c) {
+    this->ctrl[i] = c;
+    this->ctrl[((i - GROUP_WIDTH) & (this->capacity - 1)) + GROUP_WIDTH] = c;
+}
+
+/**
+ * @brief Allocates empty control bytes and uninitialized slots for cap entries.
+ */
+template <typename value_t, typename hash_t>
+void FlatHashTable<std::string, value_t, hash_t>::allocate(unsigned int cap) {
+    this->capacity = cap;
+    this->ctrl = new int8_t[cap + GROUP_WIDTH];
+    std::fill(this->ctrl, this->ctrl + cap + GROUP_WIDTH, EMPTY);
+    this->slots = static_cast<ht_pair*>(::operator new(sizeof(ht_pair) * cap));
+    // keep at least one empty slot per 8 so every probe ends at an empty group
+    this->growth_left = cap - cap / 8;
+}
+
+/**
+ * @brief Moves all pairs into a fresh table of new_capacity slots.
+ */
+template <typename value_t, typename hash_t>
+void FlatHashTable<std::string, value_t, hash_t>::rehash(unsigned int new_capacity) {
+    int8_t* old_ctrl = this->ctrl;
+    ht_pair* old_slots = this->slots;
+    unsigned int old_capacity = this->capacity;
+
+    this->allocate(new_capacity);
+    for (unsigned int i = 0; i < old_capacity; i++) {
+        if (old_ctrl[i] < 0)
+            continue;
+        uint64_t h = hash(old_slots[i].first);
+        unsigned int j = find_insert_slot(h);
+        set_ctrl(j, static_cast<int8_t>(h & 0x7F));
+        new (&this->slots[j]) ht_pair(std::move(old_slots[i]));
+        old_slots[i].~ht_pair();
+        this->growth_left--;
     }
-    return this->words[token];
+    delete[] old_ctrl;
+    ::operator delete(old_slots);
 }
 
 /**
- * @brief Prints the keys in the chain at a specific hash table position.
- * @param k The position in the hash table.
+ * @brief Probes for a key, one group of 16 control bytes at a time.
+ * @param word The key to search for.
+ * @param h The hash of word.
+ * @return The slot holding word, or -1 if it is not in the table.
  */
-void Dictionary::print(unsigned int k) {
-    this->hash_table.print(k);
+template <typename value_t, typename hash_t>
+int FlatHashTable<std::string, value_t, hash_t>::find_index(const std::string& word, uint64_t h) const {
+    const unsigned int mask = this->capacity - 1;
+    const int8_t h2 = static_cast<int8_t>(h & 0x7F);
+    unsigned int pos = (h >> 7) & mask;
+    unsigned int step = 0;
+    while (true) {
+        const int8_t* group = this->ctrl + pos;
+        for (uint32_t m = group_match(group, h2); m != 0; m &= m - 1) {
+            unsigned int i = (pos + __builtin_ctz(m)) & mask;
+            if (this->slots[i].first == word)
+                return i;
+        }
+        // an empty slot in the group means the key would have been placed there
+        if (group_match(group, EMPTY) != 0)
+            return -1;
+        step += GROUP_WIDTH;
+        pos = (pos + step) & mask;
+    }
+}
+
+/**
+ * @brief Finds the first free slot on the probe sequence of h.
+ */
+template <typename value_t, typename hash_t>
+unsigned int FlatHashTable<std::string, value_t, hash_t>::find_insert_slot(uint64_t h) const {
+    const unsigned int mask = this->capacity - 1;
+    unsigned int pos = (h >> 7) & mask;
+    unsigned int step = 0;
+    while (true) {
+        uint32_t m = group_match_free(this->ctrl + pos);
+        if (m != 0)
+            return (pos + __builtin_ctz(m)) & mask;
+        step += GROUP_WIDTH;
+        pos = (pos + step) & mask;
+    }
+}
+
+/**
+ * @brief Constructor for FlatHashTable class.
+ * @param size The minimum initial number of slots, rounded up to a power of two.
+ */
+template <typename value_t, typename hash_t>
+FlatHashTable<std::string, value_t, hash_t>::FlatHashTable(const unsigned int size) : curr_size{0} {
+    unsigned int cap = GROUP_WIDTH;
+    while (cap < size)
+        cap *= 2;
+    this->allocate(cap);
+    this->min_capacity = cap;
+}
+
+/**
+ * @brief Destructor for FlatHashTable class.
+ */
+template <typename value_t, typename hash_t>
+FlatHashTable<std::string, value_t, hash_t>::~FlatHashTable() {
+    for (unsigned int i = 0; i < this->capacity; i++) {
+        if (this->ctrl[i] >= 0)
+            this->slots[i].~ht_pair();
+    }
+    delete[] this->ctrl;
+    ::operator delete(this->slots);
+}
+
+/**
+ * @brief Inserts a key-value pair into the hash table.
+ * @param pair The key-value pair to insert.
+ * @return True if insertion is successful, false if the key already exists or is invalid.
+ */
+template <typename value_t, typename hash_t>
+bool FlatHashTable<std::string, value_t, hash_t>::insert(const ht_pair& pair) {
+    for (auto c : pair.first) {
+        if (!std::isalpha(c)) {
+            return false;
+        }
+    }
+    uint64_t h = hash(pair.first);
+    if (find_index(pair.first, h) >= 0)
+        return false;
+
+    if (this->growth_left == 0) {
+        // out of room mostly because of DELETED slots: rebuilding at the same size clears them
+        if (this->curr_size < (this->capacity - this->capacity / 8) / 2)
+            rehash(this->capacity);
+        else
+            rehash(this->capacity * 2);
+    }
+
+    unsigned int i = find_insert_slot(h);
+    // reusing a DELETED slot takes no room that was not already accounted for
+    if (this->ctrl[i] == EMPTY)
+        this->growth_left--;
+    set_ctrl(i, static_cast<int8_t>(h & 0x7F));
+    new (&this->slots[i]) ht_pair(pair);
+    this->curr_size++;
+    return true;
+}
+
+/**
+ * @brief Removes a key from the hash table.
+ * @param word The key to remove.
+ * @return True if the key was present and removed, false otherwise.
+ */
+template <typename value_t, typename hash_t>
+bool FlatHashTable<std::string, value_t, hash_t>::remove(const std::string& word) {
+    int found = find_index(word, hash(word));
+    if (found < 0)
+        return false;
+    const unsigned int i = found;
+    const unsigned int mask = this->capacity - 1;
+    this->slots[i].~ht_pair();
+    this->curr_size--;
+
+    // If the empty slots right before and right after i leave less than a full group
+    // between them, no 16-wide window covering i was ever full, so no probe went past it
+    uint32_t empty_after = group_match(this->ctrl + i, EMPTY);
+    uint32_t empty_before = group_match(this->ctrl + ((i - GROUP_WIDTH) & mask), EMPTY);
+    bool was_never_full = empty_after != 0 && empty_before != 0
+        && __builtin_ctz(empty_after) + (__builtin_clz(empty_before) - 16) < static_cast<int>(GROUP_WIDTH);
+    if (was_never_full) {
+        set_ctrl(i, EMPTY);
+        this->growth_left++;
+    } else {
+        set_ctrl(i, DELETED);
+    }
+
+    shrink();
+    return true;
+}
+
+/**
+ * @brief Shrinks the table once it is less than a quarter as full as it may get.
+ * The new capacity is the smallest one keeping the load under half the maximum.
+ * @return True if the table was resized.
+ */
+template <typename value_t, typename hash_t>
+bool FlatHashTable<std::string, value_t, hash_t>::shrink() {
+    const unsigned int max_load = this->capacity - this->capacity / 8;
+    if (this->curr_size >= max_load / 4 || this->capacity <= this->min_capacity)
+        return false;
+    unsigned int new_capacity = this->min_capacity;
+    while (this->curr_size >= (new_capacity - new_capacity / 8) / 2)
+        new_capacity *= 2;
+    if (new_capacity >= this->capacity)
+        return false;
+    rehash(new_capacity);
+    return true;
+}
+
+/**
+ * @brief Retrieves the value associated with a given string key.
+ * @param word The string key to search for.
+ * @return The value associated with the key.
+ * @throws KeyError if the key is not found in the hash table.
+ */
+template <typename value_t, typename hash_t>
+value_t FlatHashTable<std::string, value_t, hash_t>::get(const std::string& word) const {
+    const value_t* value = find(word);
+    if (value == nullptr)
+        throw KeyError(word);
+    return *value;
+}
+
+/**
+ * @brief Looks up a key without throwing.
+ * @param word The string key to search for.
+ * @return A pointer to the stored value, or nullptr if the key is absent.
+ */
+template <typename value_t, typename hash_t>
+const value_t* FlatHashTable<std::string, value_t, hash_t>::find(const std::string& word) const {
+    int i = find_index(word, hash(word));
+    return i < 0 ? nullptr : &this->slots[i].second;
+}
+
+/**
+ * @brief Copies the value of a key into value if the key is present.
+ * @param word The string key to search for.
+ * @param value Receives the value when the key is found.
+ * @return True if the key was found.
+ */
+template <typename value_t, typename hash_t>
+bool FlatHashTable<std::string, value_t, hash_t>::try_get(const std::string& word, value_t& value) const {
+    const value_t* found = find(word);
+    if (found == nullptr)
+        return false;
+    value = *found;
+    return true;
+}
+
+/**
+ * @brief Retrieves the value associated with a given string key using the [] operator.
+ * @param word The string key to search for.
+ * @return The value associated with the key.
+ */
+template <typename value_t, typename hash_t>
+value_t FlatHashTable<std::string, value_t, hash_t>::operator[](const std::string& word) const {
+    return get(word);
+}
+
+/**
+ * @brief Returns the number of pairs in the hash table.
+ * @return The current size.
+ */
+template <typename value_t, typename hash_t>
+unsigned int FlatHashTable<std::string, value_t, hash_t>::get_size() const {
+    return this->curr_size;
+}
+
+/**
+ * @brief Returns the number of slots in the hash table.
+ * @return The maximum size.
+ */
+template <typename value_t, typename hash_t>
+unsigned int FlatHashTable<std::string, value_t, hash_t>::get_max_size() const {
+    return this->capacity;
+}
+
+/**
+ * @brief Distribution of probe lengths over all stored keys.
+ * Replays the probe sequence of every key until the group containing its slot.
+ * @return histogram[n] is the number of keys found in the n-th group probed (n >= 1).
+ */
+template <typename value_t, typename hash_t>
+std::vector<unsigned int> FlatHashTable<std::string, value_t, hash_t>::probe_length_histogram() const {
+    const unsigned int mask = this->capacity - 1;
+    std::vector<unsigned int> histogram(1, 0);
+    for (unsigned int i = 0; i < this->capacity; i++) {
+        if (this->ctrl[i] < 0)
+            continue;
+        uint64_t h = hash(this->slots[i].first);
+        unsigned int pos = (h >> 7) & mask;
+        unsigned int step = 0;
+        unsigned int length = 1;
+        while (((i - pos) & mask) >= GROUP_WIDTH) {
+            step += GROUP_WIDTH;
+            pos = (pos + step) & mask;
+            length++;
+        }
+        if (histogram.size() <= length)
+            histogram.resize(length + 1, 0);
+        histogram[length]++;
+    }
+    return histogram;
+}
+
+// Instantiate the template
+template class FlatHashTable<std::string, int, PolynomialHash>;
+template class FlatHashTable<std::string, int, WyHash>;
+
+/**
+ * @brief Copies a string to the end of the arena.
+ * @param str The first character of the string.
+ * @param len The number of characters.
+ * @return The location of the copy.
+ */
+ArenaKey StringArena::append(const char* str, std::size_t len) {
+    ArenaKey key{static_cast<uint32_t>(this->bytes.size()), static_cast<uint32_t>(len)};
+    this->bytes.insert(this->bytes.end(), str, str + len);
+    return key;
+}
+
+/**
+ * @brief Exchanges the contents, and released byte counts, of two arenas.
+ */
+void StringArena::swap(StringArena& other) {
+    this->bytes.swap(other.bytes);
+    std::swap(this->released_bytes, other.released_bytes);
+}
+
+/**
+ * @brief Constructor for ArenaHashTable.
+ * @param size The initial number of buckets.
+ * @param arena Storage for the key bytes.
+ */
+template <typename value_t, typename hash_t>
+ArenaHashTable<value_t, hash_t>::ArenaHashTable(const unsigned int size, StringArena* arena) : base_t(size) {
+    this->keys.arena = arena;
+}
+
+/**
+ * @brief Inserts (key, value) if the key is absent and valid, copying the key into the arena.
+ * @param key The first character of the key.
+ * @param len The number of characters of the key.
+ * @param value The value to associate with the key.
+ * @param key_out Set to the key's location in the arena when the pair is inserted.
+ * @return True if the pair was inserted.
+ */
+template <typename value_t, typename hash_t>
+bool ArenaHashTable<value_t, hash_t>::try_emplace(const char* key, std::size_t len, const value_t& value,
+                                                  ArenaKey& key_out) {
+    return try_emplace(key, len, hash_t::hash(key, len), value, key_out);
+}
+
+/**
+ * @brief Inserts (key, value) if the key is absent and valid, hashing it only once.
+ * @param h The hash_key() of the key.
+ */
+template <typename value_t, typename hash_t>
+bool ArenaHashTable<value_t, hash_t>::try_emplace(const char* key, std::size_t len, uint64_t h,
+                                                  const value_t& value, ArenaKey& key_out) {
+    if (!this->admits(key, len, h))
+        return false;
+    key_out = this->keys.store(key, len);
+    this->link(h, ArenaKey(key_out), value);
+    return true;
+}
+
+/**
+ * @brief Replaces every stored key, in both bucket arrays, by relocate(key, value).
+ * @param relocate Gives the new location of a key with the same bytes.
+ */
+template <typename value_t, typename hash_t>
+void ArenaHashTable<value_t, hash_t>::relocate(const std::function<ArenaKey(ArenaKey, const value_t&)>& relocate) {
+    for (unsigned int i = 0; i < this->capacity; i++) {
+        for (auto& item : this->array[i])
+            item.first = relocate(item.first, item.second);
+    }
+    for (unsigned int i = this->rehash_index; this->old_array != nullptr && i < this->old_capacity; i++) {
+        for (auto& item : this->old_array[i])
+            item.first = relocate(item.first, item.second);
+    }
+}
+
+// Instantiate the template
+template class ChainedHashTable<int, PolynomialHash, ArenaKeys>;
+template class ArenaHashTable<int, PolynomialHash>;
+
+/**
+ * @brief Constructor for Dictionary class.
+ * @param size The initial size of the dictionary.
+ */
+Dictionary::Dictionary(unsigned int size) : hash_table(size, &arena) {
+    words.reserve(size);
+    words.push_back(ArenaKey{0, 0});
+}
+
+/**
+ * @brief Inserts a word into the dictionary.
+ * @param str The word to insert.
+ * @return True if insertion is successful, false otherwise.
+ */
+bool Dictionary::insert(const std::string & str) {
+    return insert(str.data(), str.size());
+}
+
+/**
+ * @brief Inserts a word given as a character range into the dictionary.
+ * @param word The first character of the word.
+ * @param len The number of characters of the word.
+ * @return True if insertion is successful, false otherwise.
+ */
+bool Dictionary::insert(const char* word, std::size_t len) {
+    if (this->image.is_open())
+        return false;
+    int token = this->free_tokens.empty() ? this->words.size() : this->free_tokens.back();
+    ArenaKey key;
+    bool _inserted = this->hash_table.try_emplace(word, len, token, key);
+    if (!_inserted)
+        return false;
+    if (this->free_tokens.empty()) {
+        this->words.push_back(key);
+    } else {
+        this->free_tokens.pop_back();
+        this->words[token] = key;
+    }
+    return true;
+}
+
+/**
+ * @brief Removes a word from the dictionary and frees its token for a later insert.
+ * @param word The word to remove.
+ * @return True if the word was in the dictionary, false otherwise.
+ */
+bool Dictionary::remove(const std::string& word) {
+    int freed;
+    if (this->image.is_open() || !this->hash_table.try_get(word.data(), word.size(), freed))
+        return false;
+    this->hash_table.remove(word.data(), word.size());
+    this->words[freed] = ArenaKey{0, 0};
+    this->free_tokens.push_back(freed);
+    // compacting once released bytes outweigh live ones bounds the arena at about
+    // twice the live words, at an amortized cost of O(1) per removed byte
+    if (2 * this->arena.released() > this->arena.size())
+        compact_arena();
+    return true;
+}
+
+/**
+ * @brief Copies the live words into a fresh arena, in token order, and points the token
+ * table and the hash table at the copies. The released bytes are freed with the old arena.
+ */
+void Dictionary::compact_arena() {
+    StringArena packed;
+    packed.reserve(this->arena.size() - this->arena.released());
+    for (std::size_t t = 1; t < this->words.size(); t++) {
+        if (this->words[t].len > 0)
+            this->words[t] = packed.append(this->arena.data(this->words[t]), this->words[t].len);
+    }
+    this->arena.swap(packed);
+    this->hash_table.relocate([this](ArenaKey, const int& token) { return this->words[token]; });
+}
+
+/**
+ * @brief Switches the word table between synchronous and incremental resizing.
+ * @param on True for incremental resizing, false for synchronous doubling.
+ */
+void Dictionary::set_incremental(bool on) {
+    this->hash_table.set_incremental(on);
+}
+
+/**
+ * @brief Retrieves the numeric token associated with a word.
+ * @param word The word to search for.
+ * @return The numeric token if the word exists, -1 otherwise.
+ */
+int Dictionary::token(const std::string& word) const {
+    return token(word.data(), word.size());
+}
+
+/**
+ * @brief Retrieves the numeric token associated with a word given as a character range.
+ * Never allocates: the lookup compares the range against the stored keys in place.
+ * @param word The first character of the word.
+ * @param len The number of characters of the word.
+ * @return The numeric token if the word exists, -1 otherwise.
+ */
+int Dictionary::token(const char* word, std::size_t len) const {
+    if (this->image.is_open())
+        return this->image.token(word, len);
+    int token = -1;
+    this->hash_table.try_get(word, len, token);
+    return token;
+}
+
+namespace {
+
+/**
+ * @brief Whitespace in the sense of std::isspace in the C locale: ' ' and '\t' through '\r'.
+ */
+inline bool is_space(char c) {
+    return c == ' ' || static_cast<unsigned char>(c - '\t') <= '\r' - '\t';
+}
+
+#if defined(__SSE2__)
+/**
+ * @brief Classifies 16 bytes at once.
+ * @param p The first of the 16 bytes.
+ * @return A mask with bit i set when p[i] is whitespace.
+ */
+inline uint32_t space_mask(const char* p) {
+    const __m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i blank = _mm_cmpeq_epi8(bytes, _mm_set1_epi8(' '));
+    // '\t'..'\r' are the bytes whose distance from '\t' is at most 4 as an unsigned value
+    const __m128i offset = _mm_sub_epi8(bytes, _mm_set1_epi8('\t'));
+    const __m128i control = _mm_cmpeq_epi8(_mm_min_epu8(offset, _mm_set1_epi8('\r' - '\t')), offset);
+    return _mm_movemask_epi8(_mm_or_si128(blank, control));
+}
+#endif
+
+/**
+ * @brief Finds the first byte of [p, end) that is (or, with want_space false, is not) whitespace.
+ * @return The position found, or end.
+ */
+inline const char* scan(const char* p, const char* end, bool want_space) {
+#if defined(__SSE2__)
+    while (end - p >= 16) {
+        uint32_t mask = space_mask(p);
+        if (!want_space)
+            mask = ~mask & 0xFFFF;
+        if (mask != 0)
+            return p + __builtin_ctz(mask);
+        p += 16;
+    }
+#endif
+    while (p != end && is_space(*p) != want_space)
+        ++p;
+    return p;
+}
+
+} // namespace
+
+/**
+ * @brief Tokenizes whitespace-separated text in a single pass.
+ * @param text The first byte of the text.
+ * @param len The number of bytes of the text.
+ * @param tokens The tokens are appended to this vector.
+ * @return The number of tokens appended.
+ */
+std::size_t Dictionary::tokenize(const char* text, std::size_t len, std::vector<int32_t>& tokens) const {
+    const std::size_t before = tokens.size();
+    const char* end = text + len;
+    const char* p = scan(text, end, false);
+    while (p != end) {
+        const char* word_end = scan(p, end, true);
+        tokens.push_back(token(p, word_end - p));
+        p = scan(word_end, end, false);
+    }
+    return tokens.size() - before;
+}
+
+/**
+ * @brief Tokenizes text into a caller-provided buffer, stopping once it is full.
+ * @param text The first byte of the text.
+ * @param len The number of bytes of the text.
+ * @param tokens The buffer receiving the tokens.
+ * @param max_tokens The capacity of the buffer.
+ * @param consumed Set to the number of bytes processed.
+ * @return The number of tokens written.
+ */
+std::size_t Dictionary::tokenize(const char* text, std::size_t len, int32_t* tokens, std::size_t max_tokens,
+                                 std::size_t& consumed) const {
+    const char* end = text + len;
+    const char* p = scan(text, end, false);
+    std::size_t count = 0;
+    while (p != end && count < max_tokens) {
+        const char* word_end = scan(p, end, true);
+        tokens[count++] = token(p, word_end - p);
+        p = scan(word_end, end, false);
+    }
+    consumed = p - text;
+    return count;
+}
+
+/**
+ * @brief Memory-maps a file and tokenizes its whole content.
+ * @param filename Path of the file.
+ * @param tokens The tokens are appended to this vector.
+ * @return False if the file could not be opened.
+ */
+bool Dictionary::tokenize_file(const std::string& filename, std::vector<int32_t>& tokens) const {
+    MappedFile file;
+    if (!file.open(filename))
+        return false;
+    tokenize(file.data(), file.size(), tokens);
+    return true;
+}
+
+/**
+ * @brief Memory-maps a file and inserts each of its whitespace-separated words.
+ * @param filename Path of the file.
+ * @return True if at least one word was inserted.
+ */
+bool Dictionary::load(const std::string& filename) {
+    MappedFile file;
+    if (this->image.is_open() || !file.open(filename))
+        return false;
+    bool success = false;
+    const char* end = file.data() + file.size();
+    const char* p = scan(file.data(), end, false);
+    while (p != end) {
+        const char* word_end = scan(p, end, true);
+        success |= insert(p, word_end - p);
+        p = scan(word_end, end, false);
+    }
+    return success;
+}
+
+/**
+ * @brief Retrieves the word associated with a numeric token.
+ * @param token The numeric token to search for.
+ * @return The word if the token exists, "N/A" otherwise.
+ */
+std::string Dictionary::ret(const int& token) {
+    StringRef word = ret_view(token);
+    return std::string(word.data, word.size);
+}
+
+/**
+ * @brief Retrieves the word associated with a numeric token without copying it.
+ * @param token The numeric token to search for.
+ * @return A view of the word in the arena if the token exists, of "N/A" otherwise.
+ */
+StringRef Dictionary::ret_view(int token) const {
+    if (this->image.is_open())
+        return this->image.ret_view(token);
+    if (token < 1 || token >= static_cast<int>(this->words.size()) || this->words[token].len == 0)
+        return StringRef{"N/A", 3};
+    return StringRef{this->arena.data(this->words[token]), this->words[token].len};
+}
+
+/**
+ * @brief One past the largest token handed out so far.
+ */
+int Dictionary::num_tokens() const {
+    if (this->image.is_open())
+        return this->image.num_tokens();
+    return this->words.size();
+}
+
+/**
+ * @brief Prints the keys in the chain at a specific hash table position.
+ * @param k The position in the hash table.
+ */
+void Dictionary::print(unsigned int k) {
+    // a mapped image has no chains to show
+    if (!this->image.is_open())
+        this->hash_table.print(k);
+}
+
+/**
+ * @brief Distribution of chain lengths in the dictionary's hash table.
+ * @return histogram[n] is the number of buckets holding exactly n words.
+ */
+std::vector<unsigned int> Dictionary::chain_length_histogram() const {
+    return this->hash_table.chain_length_histogram();
+}
+
+HashTableStats Dictionary::stats() const {
+    HashTableStats stats = this->hash_table.stats();
+    stats.bytes += this->arena.size() + this->words.capacity() * sizeof(ArenaKey)
+                   + this->free_tokens.capacity() * sizeof(int);
+    return stats;
+}
+
+/**
+ * @brief Writes the vocabulary to a file that open() can map.
+ * @param filename Path of the file.
+ * @return False if the file could not be written.
+ */
+bool Dictionary::save(const std::string& filename) const {
+    if (this->image.is_open())
+        return false;
+    return VocabImage::write(filename, this->words, this->arena);
+}
+
+/**
+ * @brief Serves lookups from a vocabulary file written by save().
+ * @param filename Path of the file.
+ * @return False if the file could not be opened or is not a vocabulary image.
+ */
+bool Dictionary::open(const std::string& filename) {
+    return this->image.open(filename);
+}
+
+/**
+ * @brief Unmaps the vocabulary file, if any, and goes back to the in-memory words.
+ */
+void Dictionary::close() {
+    this->image.close();
+}
+
+const char VocabImage::MAGIC[8] = {'T', 'O', 'K', 'V', 'O', 'C', 'A', 'B'};
+const uint32_t VocabImage::VERSION;
+
+/**
+ * @brief Writes an image of a vocabulary.
+ * @param filename Path of the file.
+ * @param words The word of every token, len 0 for unused tokens.
+ * @param arena The storage words point into.
+ * @return False if the file could not be written.
+ */
+bool VocabImage::write(const std::string& filename, const std::vector<ArenaKey>& words, const StringArena& arena) {
+    VocabImageHeader header{};
+    std::copy(MAGIC, MAGIC + 8, header.magic);
+    header.version = VERSION;
+    header.num_tokens = words.size();
+
+    // Compact the live words into a fresh arena, in token order
+    std::vector<ArenaKey> packed(words.size(), ArenaKey{0, 0});
+    std::vector<char> bytes;
+    unsigned int num_words = 0;
+    for (std::size_t t = 1; t < words.size(); t++) {
+        if (words[t].len == 0)
+            continue;
+        packed[t] = ArenaKey{static_cast<uint32_t>(bytes.size()), words[t].len};
+        bytes.insert(bytes.end(), arena.data(words[t]), arena.data(words[t]) + words[t].len);
+        num_words++;
+    }
+    header.arena_size = bytes.size();
+
+    // Index at a load of at most 1/2
+    header.index_capacity = 16;
+    while (header.index_capacity < 2 * num_words)
+        header.index_capacity *= 2;
+    std::vector<uint32_t> index(header.index_capacity, 0);
+    const uint32_t mask = header.index_capacity - 1;
+    for (std::size_t t = 1; t < packed.size(); t++) {
+        if (packed[t].len == 0)
+            continue;
+        uint32_t i = WyHash::hash(bytes.data() + packed[t].offset, packed[t].len) & mask;
+        while (index[i] != 0)
+            i = (i + 1) & mask;
+        index[i] = t;
+    }
+
+    std::ofstream out(filename.c_str(), std::ios::binary);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(reinterpret_cast<const char*>(packed.data()), packed.size() * sizeof(ArenaKey));
+    out.write(reinterpret_cast<const char*>(index.data()), index.size() * sizeof(uint32_t));
+    out.write(bytes.data(), bytes.size());
+    return static_cast<bool>(out);
+}
+
+/**
+ * @brief Maps an image into memory and validates it: the header, every word range against
+ * the arena and every index entry against the token table. This reads the file once and
+ * hashes nothing.
+ * @param filename Path of the file.
+ * @return False if the file could not be opened or is not a valid image.
+ */
+bool VocabImage::open(const std::string& filename) {
+    this->close();
+    if (!this->file.open(filename))
+        return false;
+
+    const std::size_t size = this->file.size();
+    const VocabImageHeader* header = reinterpret_cast<const VocabImageHeader*>(this->file.data());
+    if (size < sizeof(VocabImageHeader) || !std::equal(MAGIC, MAGIC + 8, header->magic)
+            || header->version != VERSION || header->num_tokens == 0 || header->index_capacity == 0
+            || (header->index_capacity & (header->index_capacity - 1)) != 0
+            || size != sizeof(VocabImageHeader) + std::size_t(header->num_tokens) * sizeof(ArenaKey)
+                       + std::size_t(header->index_capacity) * sizeof(uint32_t) + header->arena_size) {
+        this->file.close();
+        return false;
+    }
+
+    const ArenaKey* words = reinterpret_cast<const ArenaKey*>(this->file.data() + sizeof(VocabImageHeader));
+    const uint32_t* index = reinterpret_cast<const uint32_t*>(words + header->num_tokens);
+    bool valid = true;
+    for (uint32_t t = 0; t < header->num_tokens && valid; t++)
+        valid = uint64_t(words[t].offset) + words[t].len <= header->arena_size;
+    // probing stops at the first empty slot, so there must be one
+    bool has_empty = false;
+    for (uint32_t i = 0; i < header->index_capacity && valid; i++) {
+        if (index[i] == 0)
+            has_empty = true;
+        else
+            valid = index[i] < header->num_tokens && words[index[i]].len != 0;
+    }
+    if (!valid || !has_empty) {
+        this->file.close();
+        return false;
+    }
+
+    this->header = header;
+    this->words = words;
+    this->index = index;
+    this->arena = reinterpret_cast<const char*>(this->index + header->index_capacity);
+    return true;
+}
+
+void VocabImage::close() {
+    this->file.close();
+    this->header = nullptr;
+    this->words = nullptr;
+    this->index = nullptr;
+    this->arena = nullptr;
+}
+
+/**
+ * @brief Retrieves the numeric token of a word by probing the mapped index.
+ * @return The numeric token if the word exists, -1 otherwise.
+ */
+int VocabImage::token(const char* word, std::size_t len) const {
+    const uint32_t mask = this->header->index_capacity - 1;
+    for (uint32_t i = WyHash::hash(word, len) & mask; this->index[i] != 0; i = (i + 1) & mask) {
+        const ArenaKey& key = this->words[this->index[i]];
+        if (key.len == len && std::memcmp(this->arena + key.offset, word, len) == 0)
+            return this->index[i];
+    }
+    return -1;
+}
+
+/**
+ * @brief Retrieves the word of a token as a view into the mapping.
+ * @return The word if the token exists, "N/A" otherwise.
+ */
+StringRef VocabImage::ret_view(int token) const {
+    if (token < 1 || static_cast<uint32_t>(token) >= this->header->num_tokens || this->words[token].len == 0)
+        return StringRef{"N/A", 3};
+    return StringRef{this->arena + this->words[token].offset, this->words[token].len};
+}
+
+/**
+ * @brief Builds the piece trie from every word of the dictionary.
+ * @param dict The vocabulary, which must outlive the tokenizer.
+ */
+SubwordTokenizer::SubwordTokenizer(const Dictionary& dict) : dict(dict), byte_base(dict.num_tokens()) {
+    // Build with per-node child lists, then flatten into sorted edge arrays
+    std::vector<std::vector<TrieEdge>> children(1);
+    std::vector<int32_t> tokens(1, -1);
+    for (int token = 1; token < this->byte_base; token++) {
+        StringRef word = dict.ret_view(token);
+        if (dict.token(word.data, word.size) != token)
+            continue; // a removed token
+        uint32_t node = 0;
+        for (std::size_t i = 0; i < word.size; i++) {
+            const uint8_t label = word.data[i];
+            uint32_t next = 0;
+            for (const TrieEdge& e : children[node]) {
+                if (e.label == label) {
+                    next = e.target;
+                    break;
+                }
+            }
+            if (next == 0) {
+                next = children.size();
+                children[node].push_back(TrieEdge{label, next});
+                children.emplace_back();
+                tokens.push_back(-1);
+            }
+            node = next;
+        }
+        tokens[node] = token;
+    }
+
+    this->nodes.resize(children.size());
+    for (std::size_t n = 0; n < children.size(); n++) {
+        std::sort(children[n].begin(), children[n].end(),
+                  [](const TrieEdge& a, const TrieEdge& b) { return a.label < b.label; });
+        this->nodes[n] = TrieNode{static_cast<uint32_t>(this->edges.size()),
+                                  static_cast<uint16_t>(children[n].size()), tokens[n]};
+        this->edges.insert(this->edges.end(), children[n].begin(), children[n].end());
+        std::vector<TrieEdge>().swap(children[n]);
+    }
+    std::fill(this->root_children, this->root_children + 256, 0);
+    for (uint32_t e = 0; e < this->nodes[0].num_edges; e++)
+        this->root_children[this->edges[e].label] = this->edges[e].target;
+}
+
+/**
+ * @brief Returns the child of node along label, or -1 if there is none.
+ */
+int64_t SubwordTokenizer::child(uint32_t node, uint8_t label) const {
+    if (node == 0)
+        return this->root_children[label] == 0 ? -1 : static_cast<int64_t>(this->root_children[label]);
+    const TrieNode& n = this->nodes[node];
+    const TrieEdge* first = this->edges.data() + n.first_edge;
+    const TrieEdge* last = first + n.num_edges;
+    const TrieEdge* e = std::lower_bound(first, last, label,
+                                         [](const TrieEdge& edge, uint8_t l) { return edge.label < l; });
+    return e != last && e->label == label ? static_cast<int64_t>(e->target) : -1;
+}
+
+/**
+ * @brief Greedy longest-match split of one word.
+ */
+void SubwordTokenizer::wordpiece(const char* word, std::size_t len, std::vector<int32_t>& tokens) const {
+    std::size_t i = 0;
+    while (i < len) {
+        // walk the trie as far as the word allows, remembering the longest piece passed
+        std::size_t best_len = 0;
+        int32_t best_token = -1;
+        int64_t node = 0;
+        for (std::size_t j = i; j < len; j++) {
+            node = child(node, word[j]);
+            if (node < 0)
+                break;
+            if (this->nodes[node].token >= 0) {
+                best_len = j + 1 - i;
+                best_token = this->nodes[node].token;
+            }
+        }
+        if (best_len == 0) {
+            tokens.push_back(byte_token(word[i]));
+            i++;
+        } else {
+            tokens.push_back(best_token);
+            i += best_len;
+        }
+    }
+}
+
+/**
+ * @brief Byte-pair merge of one word, lowest token first.
+ */
+void SubwordTokenizer::bpe(const char* word, std::size_t len, std::vector<int32_t>& tokens) const {
+    // a word of the vocabulary is its own piece, whatever pairs the vocabulary lacks
+    const int32_t whole = this->dict.token(word, len);
+    if (whole >= 0) {
+        tokens.push_back(whole);
+        return;
+    }
+
+    // The parts form a linked list over their first bytes: the part starting at s ends
+    // at next[s], and prev[s] is where the part before it starts
+    const std::size_t NONE = static_cast<std::size_t>(-1);
+    std::vector<std::size_t> next(len), prev(len);
+    for (std::size_t s = 0; s < len; s++) {
+        next[s] = s + 1;
+        prev[s] = s == 0 ? NONE : s - 1;
+    }
+
+    // Candidate merges by (token, start), so the lowest token wins and ties go to the
+    // leftmost pair. An entry is stale once either part has grown: its end no longer matches.
+    struct Merge {
+        int32_t token;
+        std::size_t start;
+        std::size_t end;
+        bool operator>(const Merge& other) const {
+            return this->token > other.token || (this->token == other.token && this->start > other.start);
+        }
+    };
+    std::priority_queue<Merge, std::vector<Merge>, std::greater<Merge>> queue;
+    auto push_pair = [&](std::size_t s) {
+        if (next[s] >= len)
+            return;
+        const std::size_t end = next[next[s]];
+        const int32_t token = this->dict.token(word + s, end - s);
+        if (token >= 0)
+            queue.push(Merge{token, s, end});
+    };
+    for (std::size_t s = 0; s + 1 < len; s++)
+        push_pair(s);
+
+    while (!queue.empty()) {
+        const Merge merge = queue.top();
+        queue.pop();
+        const std::size_t s = merge.start;
+        if (next[s] == NONE || next[s] >= len || next[next[s]] != merge.end)
+            continue;
+        const std::size_t right = next[s];
+        next[s] = merge.end;
+        if (merge.end < len)
+            prev[merge.end] = s;
+        next[right] = NONE;
+        push_pair(s);
+        if (prev[s] != NONE)
+            push_pair(prev[s]);
+    }
+
+    for (std::size_t s = 0; s < len; s = next[s]) {
+        // merged parts are always pieces, single bytes may not be
+        int32_t token = this->dict.token(word + s, next[s] - s);
+        tokens.push_back(token >= 0 ? token : byte_token(word[s]));
+    }
+}
+
+/**
+ * @brief Splits every whitespace-separated word of text into pieces.
+ * @param text The first byte of the text.
+ * @param len The number of bytes of the text.
+ * @param tokens The tokens are appended to this vector.
+ * @param mode WORDPIECE or BPE.
+ * @return The number of tokens appended.
+ */
+std::size_t SubwordTokenizer::encode(const char* text, std::size_t len, std::vector<int32_t>& tokens, Mode mode) const {
+    const std::size_t before = tokens.size();
+    const char* end = text + len;
+    const char* p = scan(text, end, false);
+    while (p != end) {
+        const char* word_end = scan(p, end, true);
+        if (mode == WORDPIECE)
+            wordpiece(p, word_end - p, tokens);
+        else
+            bpe(p, word_end - p, tokens);
+        p = scan(word_end, end, false);
+    }
+    return tokens.size() - before;
+}
+
+/**
+ * @brief The bytes a token stands for.
+ * @param token A dictionary token or a byte token.
+ * @return The word or byte, or "N/A" for anything else.
+ */
+StringRef SubwordTokenizer::piece(int32_t token) const {
+    static const std::string bytes = []() {
+        std::string all(256, '\0');
+        for (int b = 0; b < 256; b++)
+            all[b] = static_cast<char>(b);
+        return all;
+    }();
+    if (token >= this->byte_base && token < this->byte_base + 256)
+        return StringRef{bytes.data() + (token - this->byte_base), 1};
+    return this->dict.ret_view(token);
+}
+
+const unsigned int ConcurrentDictionary::CHUNK_BITS;
+const unsigned int ConcurrentDictionary::NUM_CHUNKS;
+
+/**
+ * @brief Constructor for ConcurrentDictionary class.
+ * @param num_shards Number of shards, rounded up to a power of two.
+ */
+ConcurrentDictionary::ConcurrentDictionary(unsigned int num_shards)
+    : num_shards{1}, next_token{1}, chunks{new std::atomic<std::atomic<Entry*>*>[NUM_CHUNKS]} {
+    while (this->num_shards < num_shards)
+        this->num_shards *= 2;
+    this->shards.reset(new Shard[this->num_shards]);
+    for (unsigned int i = 0; i < this->num_shards; i++) {
+        this->shards[i].table.store(new_table(16), std::memory_order_relaxed);
+        this->shards[i].size = 0;
+    }
+    for (unsigned int i = 0; i < NUM_CHUNKS; i++)
+        this->chunks[i].store(nullptr, std::memory_order_relaxed);
+}
+
+/**
+ * @brief Destructor for ConcurrentDictionary class. Must not run concurrently with any other call.
+ */
+ConcurrentDictionary::~ConcurrentDictionary() {
+    for (unsigned int i = 0; i < NUM_CHUNKS; i++) {
+        std::atomic<Entry*>* chunk = this->chunks[i].load(std::memory_order_relaxed);
+        if (chunk == nullptr)
+            continue;
+        for (unsigned int j = 0; j < (1u << CHUNK_BITS); j++)
+            delete chunk[j].load(std::memory_order_relaxed);
+        delete[] chunk;
+    }
+    for (unsigned int i = 0; i < this->num_shards; i++) {
+        this->shards[i].retired.push_back(this->shards[i].table.load(std::memory_order_relaxed));
+        for (Table* table : this->shards[i].retired) {
+            delete[] table->slots;
+            delete table;
+        }
+    }
+}
+
+/**
+ * @brief Allocates a table with every slot empty.
+ */
+ConcurrentDictionary::Table* ConcurrentDictionary::new_table(unsigned int capacity) {
+    Table* table = new Table{capacity, new std::atomic<Entry*>[capacity]};
+    for (unsigned int i = 0; i < capacity; i++)
+        table->slots[i].store(nullptr, std::memory_order_relaxed);
+    return table;
+}
+
+/**
+ * @brief The shard of a hash. Shards use the high half of the hash, slots the low half.
+ */
+ConcurrentDictionary::Shard& ConcurrentDictionary::shard_of(uint64_t h) const {
+    return this->shards[(h >> 32) & (this->num_shards - 1)];
+}
+
+/**
+ * @brief Probes the current table of the shard of h without locking.
+ * @return The entry of the word, or nullptr if it is not (yet) visible.
+ */
+const ConcurrentDictionary::Entry* ConcurrentDictionary::find(const char* word, std::size_t len, uint64_t h) const {
+    const Table* table = shard_of(h).table.load(std::memory_order_acquire);
+    const unsigned int mask = table->capacity - 1;
+    for (unsigned int i = h & mask; ; i = (i + 1) & mask) {
+        const Entry* entry = table->slots[i].load(std::memory_order_acquire);
+        if (entry == nullptr)
+            return nullptr;
+        if (entry->hash == h && entry->word.size() == len && std::memcmp(entry->word.data(), word, len) == 0)
+            return entry;
+    }
+}
+
+/**
+ * @brief Makes an entry reachable from its token, allocating the directory chunk if needed.
+ */
+void ConcurrentDictionary::publish_token(Entry* entry) {
+    std::atomic<std::atomic<Entry*>*>& slot = this->chunks[entry->token >> CHUNK_BITS];
+    std::atomic<Entry*>* chunk = slot.load(std::memory_order_acquire);
+    if (chunk == nullptr) {
+        // writers of different shards may race for the chunk; the loser frees its copy
+        std::atomic<Entry*>* fresh = new std::atomic<Entry*>[1u << CHUNK_BITS];
+        for (unsigned int i = 0; i < (1u << CHUNK_BITS); i++)
+            fresh[i].store(nullptr, std::memory_order_relaxed);
+        if (slot.compare_exchange_strong(chunk, fresh, std::memory_order_acq_rel)) {
+            chunk = fresh;
+        } else {
+            delete[] fresh;
+        }
+    }
+    chunk[entry->token & ((1u << CHUNK_BITS) - 1)].store(entry, std::memory_order_release);
+}
+
+/**
+ * @brief Inserts a word and assigns it the next token.
+ * @param word The first character of the word.
+ * @param len The number of characters of the word.
+ * @return True if insertion is successful, false if the word exists or is not alphabetic.
+ */
+bool ConcurrentDictionary::insert(const char* word, std::size_t len) {
+    for (std::size_t i = 0; i < len; i++) {
+        if (!std::isalpha(word[i]))
+            return false;
+    }
+    const uint64_t h = WyHash::hash(word, len);
+    Shard& shard = shard_of(h);
+    std::lock_guard<std::mutex> guard(shard.lock);
+    // under the lock the current table is complete, so a miss here is final
+    if (find(word, len, h) != nullptr)
+        return false;
+    // the counter is shared by all shards, so claim the token with a CAS that refuses to
+    // move it past the directory; checking it first and adding later would let two
+    // writers of different shards both pass the check for the last token
+    int32_t token = this->next_token.load(std::memory_order_relaxed);
+    do {
+        if (NUM_CHUNKS <= static_cast<unsigned int>(token) >> CHUNK_BITS)
+            return false;
+    } while (!this->next_token.compare_exchange_weak(token, token + 1, std::memory_order_relaxed));
+
+    Table* table = shard.table.load(std::memory_order_relaxed);
+    if (2 * (shard.size + 1) > table->capacity) {
+        // keep the load under 1/2: build the doubled copy, then swap it in
+        Table* bigger = new_table(table->capacity * 2);
+        const unsigned int mask = bigger->capacity - 1;
+        for (unsigned int i = 0; i < table->capacity; i++) {
+            Entry* entry = table->slots[i].load(std::memory_order_relaxed);
+            if (entry == nullptr)
+                continue;
+            unsigned int j = entry->hash & mask;
+            while (bigger->slots[j].load(std::memory_order_relaxed) != nullptr)
+                j = (j + 1) & mask;
+            bigger->slots[j].store(entry, std::memory_order_relaxed);
+        }
+        shard.table.store(bigger, std::memory_order_release);
+        shard.retired.push_back(table);
+        table = bigger;
+    }
+
+    Entry* entry = new Entry{h, token, std::string(word, len)};
+    publish_token(entry);
+    const unsigned int mask = table->capacity - 1;
+    unsigned int i = h & mask;
+    while (table->slots[i].load(std::memory_order_relaxed) != nullptr)
+        i = (i + 1) & mask;
+    table->slots[i].store(entry, std::memory_order_release);
+    shard.size++;
+    return true;
+}
+
+bool ConcurrentDictionary::insert(const std::string& word) {
+    return insert(word.data(), word.size());
+}
+
+/**
+ * @brief Retrieves the numeric token associated with a word, without locking.
+ * @return The numeric token if the word exists, -1 otherwise.
+ */
+int ConcurrentDictionary::token(const char* word, std::size_t len) const {
+    const Entry* entry = find(word, len, WyHash::hash(word, len));
+    return entry == nullptr ? -1 : entry->token;
+}
+
+int ConcurrentDictionary::token(const std::string& word) const {
+    return token(word.data(), word.size());
+}
+
+/**
+ * @brief Tokenizes whitespace-separated text, as Dictionary::tokenize does.
+ * @return The number of tokens appended.
+ */
+std::size_t ConcurrentDictionary::tokenize(const char* text, std::size_t len, std::vector<int32_t>& tokens) const {
+    const std::size_t before = tokens.size();
+    const char* end = text + len;
+    const char* p = scan(text, end, false);
+    while (p != end) {
+        const char* word_end = scan(p, end, true);
+        tokens.push_back(token(p, word_end - p));
+        p = scan(word_end, end, false);
+    }
+    return tokens.size() - before;
+}
+
+/**
+ * @brief Retrieves the word associated with a numeric token without copying it.
+ * @param token The numeric token to search for.
+ * @return A view of the word if the token exists, of "N/A" otherwise.
+ */
+StringRef ConcurrentDictionary::ret_view(int token) const {
+    if (token < 1 || static_cast<unsigned int>(token) >> CHUNK_BITS >= NUM_CHUNKS)
+        return StringRef{"N/A", 3};
+    const std::atomic<Entry*>* chunk = this->chunks[token >> CHUNK_BITS].load(std::memory_order_acquire);
+    const Entry* entry = chunk == nullptr ? nullptr
+        : chunk[token & ((1u << CHUNK_BITS) - 1)].load(std::memory_order_acquire);
+    if (entry == nullptr)
+        return StringRef{"N/A", 3};
+    return StringRef{entry->word.data(), entry->word.size()};
+}
+
+std::string ConcurrentDictionary::ret(int token) const {
+    StringRef word = ret_view(token);
+    return std::string(word.data, word.size);
+}
+
+/**
+ * @brief Number of tokens assigned so far.
+ */
+unsigned int ConcurrentDictionary::size() const {
+    return this->next_token.load(std::memory_order_relaxed) - 1;
 }
 
-// template <typename value_t>
-// HashTable<std::string, value_t>::HashTable(const HashTable& other) : curr_size(other.curr_size), capacity(other.capacity) {
+// template <typename value_t, typename hash_t>
+// HashTable<std::string, value_t, hash_t>::HashTable(const HashTable& other) : curr_size(other.curr_size), capacity(other.capacity) {
 //     // Allocate a new array
 //     array = new std::forward_list<ht_pair>[capacity];
 
@@ -239,8 +2097,8 @@ void Dictionary::print(unsigned int k) {
 //     }
 // }
 
-// template <typename value_t>
-// HashTable<std::string, value_t>& HashTable<std::string, value_t>::operator=(const HashTable<std::string, value_t>& other) {
+// template <typename value_t, typename hash_t>
+// HashTable<std::string, value_t>& HashTable<std::string, value_t, hash_t>::operator=(const HashTable<std::string, value_t>& other) {
 //     if (this != &other) {
 //         // Create a temporary copy of the other hash table
 //         HashTable<std::string, value_t> temp(other);
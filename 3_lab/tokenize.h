@@ -1,77 +1,1006 @@
 // tokenize.h
 #pragma once
 #include <iostream>
+#include <string>
 #include <vector>
 #include <cctype>
 #include <forward_list>
 #include <exception>
+#include <cstdint>
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <cstring>
+#include <type_traits>
+#include <functional>
 
 using kv_pair = std::pair<std::string, unsigned int>;
 
+/**
+ * @brief Read-only memory mapping of a whole file, unmapped when the object goes out of scope.
+ */
+class MappedFile {
+private:
+    const char* data_;
+    std::size_t size_;
+public:
+    MappedFile() : data_{nullptr}, size_{0} {};
+    MappedFile(const MappedFile& other) = delete;
+    MappedFile& operator=(const MappedFile& other) = delete;
+    ~MappedFile() { this->close(); }
+
+    bool open(const std::string& filename);
+    void close();
+
+    const char* data() const { return this->data_; }
+    std::size_t size() const { return this->size_; }
+};
+
+/**
+ * @brief Thrown by get() for a missing key. The message is only built if what() is called,
+ * so a caught miss costs no more than copying the key.
+ */
 class KeyError : public std::exception {
 public:
     KeyError(const std::string& key);
     const char* what() const noexcept override;
+    const std::string& key() const noexcept { return key_; }
 
 private:
     std::string key_;
-    std::string error_msg;
+    mutable std::string error_msg;
+};
+
+/**
+ * @brief Snapshot of a hash table's activity and layout, see HashTable::stats().
+ * 
+ * The layout fields (size, capacity, bytes, chain_lengths) are computed when the
+ * snapshot is taken. The activity counters are only kept when the program is built with
+ * -DHASHTABLE_STATS; otherwise they stay 0, enabled is false, and the hot paths carry no
+ * counting code at all.
+ */
+struct HashTableStats {
+    bool enabled = false;
+    uint64_t lookups = 0;
+    uint64_t hits = 0;
+    uint64_t misses = 0;
+    uint64_t probes = 0; // keys compared by lookups
+    uint64_t inserts = 0;
+    uint64_t removes = 0;
+    uint64_t resizes = 0;
+    double resize_ms = 0; // total time spent resizing
+    unsigned int size = 0;
+    unsigned int capacity = 0;
+    uint64_t bytes = 0; // bucket array, chain nodes and key bytes currently held
+    std::vector<unsigned int> chain_lengths; // chain_lengths[n] buckets hold n pairs
+
+    std::string to_json() const;
+    void print(std::ostream& out) const;
+};
+
+#ifdef HASHTABLE_STATS
+/**
+ * @brief Activity counters of one hash table. Relaxed atomics, since const lookups may
+ * run on several threads at once (Dictionary::load does).
+ */
+struct HashTableCounters {
+    std::atomic<uint64_t> lookups{0};
+    std::atomic<uint64_t> hits{0};
+    std::atomic<uint64_t> misses{0};
+    std::atomic<uint64_t> probes{0};
+    std::atomic<uint64_t> inserts{0};
+    std::atomic<uint64_t> removes{0};
+    std::atomic<uint64_t> resizes{0};
+    std::atomic<uint64_t> resize_ns{0};
+
+    void fill(HashTableStats& stats) const;
+};
+#define HASHTABLE_COUNT(field, n) this->counters.field.fetch_add(n, std::memory_order_relaxed)
+#else
+#define HASHTABLE_COUNT(field, n) ((void)0)
+#endif
+
+/**
+ * @brief Hash policy implementing the assignment's hash: ans = ans * 29 + c, reduced modulo the capacity.
+ * 
+ * A hash policy provides hash() over the bytes of a key, index() to reduce a hash to a
+ * bucket, and capacity_for() to pick a capacity the reduction supports.
+ */
+struct PolynomialHash {
+    static uint64_t hash(const char* str, std::size_t len);
+    static unsigned int index(uint64_t h, unsigned int capacity) { return h % capacity; }
+    static unsigned int capacity_for(unsigned int size) { return size; }
+};
+
+/**
+ * @brief wyhash-style hash policy: 64-bit multiply-and-fold mixing over 8-byte reads.
+ * 
+ * Every output bit depends on every input byte, so common English prefixes and suffixes
+ * do not cluster, and the low bits are good enough to pick a bucket with a mask instead
+ * of an integer division. Capacities are rounded up to powers of two.
+ */
+struct WyHash {
+    static uint64_t hash(const char* str, std::size_t len);
+    static unsigned int index(uint64_t h, unsigned int capacity) { return h & (capacity - 1); }
+    static unsigned int capacity_for(unsigned int size) {
+        unsigned int capacity = 1;
+        while (capacity < size)
+            capacity *= 2;
+        return capacity;
+    }
 };
 
 /**
  * @brief A general hash table template for key-value pairs.
  * 
+ * The primary template serves fixed-size, trivially copyable keys such as token IDs or
+ * 16-byte digests, and is defined here in the header so any such key type can be used.
+ * Keys, values and the full/empty flag are stored inline in one slot array (linear probing), so there is
+ * no heap node per pair and no string hashing: the hash policy sees the key's bytes.
+ * Probing tests "slot empty or key found" with one combined condition per slot, so the
+ * loop has a single, well-predicted exit branch. Removal shifts the following pairs
+ * back instead of leaving tombstones, so probe lengths do not grow with churn.
+ * 
+ * Keys are compared bytewise, so key types must not contain padding.
+ * 
  * @tparam key_t The type of the key.
  * @tparam value_t The type of the value.
+ * @tparam hash_t The hash policy, see PolynomialHash.
  */
-template<typename key_t, typename value_t>
-class HashTable;
+template<typename key_t, typename value_t, typename hash_t = WyHash>
+class HashTable {
+    static_assert(std::is_trivially_copyable<key_t>::value, "HashTable keys must be trivially copyable");
+    struct Slot {
+        key_t key;
+        value_t value;
+        uint8_t used; // 1 for a full slot, kept next to the key so a probe touches one cache line
+    };
+private:
+    std::vector<Slot> slots;
+    unsigned int curr_size = 0;
+    unsigned int capacity = 0; // power of two
+    unsigned int min_capacity = 0;
+
+    static uint64_t hash(const key_t& key) {
+        return hash_t::hash(reinterpret_cast<const char*>(&key), sizeof(key_t));
+    }
+    static bool equal(const key_t& a, const key_t& b) {
+        return std::memcmp(&a, &b, sizeof(key_t)) == 0;
+    }
+    unsigned int home(const key_t& key) const { return hash(key) & (this->capacity - 1); }
+    unsigned int slot_of(const key_t& key) const;
+    void rehash(unsigned int new_capacity);
+public:
+    /**
+     * @param size The minimum initial number of slots, rounded up to a power of two.
+     */
+    explicit HashTable(const unsigned int size = 16);
+
+    /**
+     * @brief Inserts (key, value) only if the key is absent.
+     * @return True if the pair was inserted, false if the key exists.
+     */
+    bool try_emplace(const key_t& key, const value_t& value);
+    bool insert(const std::pair<key_t, value_t>& pair) { return try_emplace(pair.first, pair.second); }
+
+    /**
+     * @brief Looks up a key.
+     * @return A pointer to the stored value, or nullptr if the key is absent. The pointer
+     * is invalidated by the next insert or remove.
+     */
+    const value_t* find(const key_t& key) const;
+    bool try_get(const key_t& key, value_t& value) const;
+    bool remove(const key_t& key);
+    unsigned int get_size() const { return this->curr_size; }
+    unsigned int get_max_size() const { return this->capacity; }
+
+    /**
+     * @brief Distribution of probe lengths over all stored keys.
+     * @return histogram[n] is the number of keys found at the n-th slot probed (n >= 1).
+     */
+    std::vector<unsigned int> probe_length_histogram() const;
+};
 
 /**
- * @brief A hash table template specialization for key-value pairs with string keys.
+ * @brief Constructor for the fixed-key HashTable.
+ * @param size The minimum initial number of slots, rounded up to a power of two.
+ */
+template <typename key_t, typename value_t, typename hash_t>
+HashTable<key_t, value_t, hash_t>::HashTable(const unsigned int size) {
+    unsigned int cap = 16;
+    while (cap < size)
+        cap *= 2;
+    // value-initialized slots keep the key comparison on empty slots well defined
+    this->slots.assign(cap, Slot());
+    this->capacity = cap;
+    this->min_capacity = cap;
+}
+
+/**
+ * @brief Finds the slot holding key, or the empty slot that ends its probe sequence.
+ */
+template <typename key_t, typename value_t, typename hash_t>
+unsigned int HashTable<key_t, value_t, hash_t>::slot_of(const key_t& key) const {
+    const unsigned int mask = this->capacity - 1;
+    unsigned int i = home(key);
+    // '&' rather than '&&': both tests are evaluated and combined into one exit branch
+    while (this->slots[i].used & !equal(this->slots[i].key, key))
+        i = (i + 1) & mask;
+    return i;
+}
+
+/**
+ * @brief Moves all pairs into a table of new_capacity slots.
+ */
+template <typename key_t, typename value_t, typename hash_t>
+void HashTable<key_t, value_t, hash_t>::rehash(unsigned int new_capacity) {
+    std::vector<Slot> old_slots(new_capacity, Slot());
+    old_slots.swap(this->slots);
+    this->capacity = new_capacity;
+    for (std::size_t j = 0; j < old_slots.size(); j++) {
+        if (old_slots[j].used)
+            this->slots[slot_of(old_slots[j].key)] = old_slots[j];
+    }
+}
+
+/**
+ * @brief Inserts (key, value) only if the key is absent, growing at a load of 3/4.
+ * @param key The key.
+ * @param value The value to associate with the key.
+ * @return True if the pair was inserted.
+ */
+template <typename key_t, typename value_t, typename hash_t>
+bool HashTable<key_t, value_t, hash_t>::try_emplace(const key_t& key, const value_t& value) {
+    unsigned int i = slot_of(key);
+    if (this->slots[i].used)
+        return false;
+    if (4 * (this->curr_size + 1) > 3 * this->capacity) {
+        rehash(this->capacity * 2);
+        i = slot_of(key);
+    }
+    this->slots[i].key = key;
+    this->slots[i].value = value;
+    this->slots[i].used = 1;
+    this->curr_size++;
+    return true;
+}
+
+/**
+ * @brief Looks up a key.
+ * @param key The key to search for.
+ * @return A pointer to the stored value, or nullptr if the key is absent.
+ */
+template <typename key_t, typename value_t, typename hash_t>
+const value_t* HashTable<key_t, value_t, hash_t>::find(const key_t& key) const {
+    const unsigned int i = slot_of(key);
+    return this->slots[i].used ? &this->slots[i].value : nullptr;
+}
+
+/**
+ * @brief Copies the value of a key into value if the key is present.
+ * @return True if the key was found.
+ */
+template <typename key_t, typename value_t, typename hash_t>
+bool HashTable<key_t, value_t, hash_t>::try_get(const key_t& key, value_t& value) const {
+    const value_t* found = find(key);
+    if (found == nullptr)
+        return false;
+    value = *found;
+    return true;
+}
+
+/**
+ * @brief Removes a key, shifting back the pairs whose probe sequence ran through its slot.
+ * Shrinks to half the capacity once the load is below 1/8.
+ * @param key The key to remove.
+ * @return True if the key was present.
+ */
+template <typename key_t, typename value_t, typename hash_t>
+bool HashTable<key_t, value_t, hash_t>::remove(const key_t& key) {
+    const unsigned int mask = this->capacity - 1;
+    unsigned int hole = slot_of(key);
+    if (!this->slots[hole].used)
+        return false;
+    for (unsigned int j = (hole + 1) & mask; this->slots[j].used; j = (j + 1) & mask) {
+        // the pair at j may fill the hole if the hole lies between its home and j
+        if (((j - home(this->slots[j].key)) & mask) >= ((j - hole) & mask)) {
+            this->slots[hole] = this->slots[j];
+            hole = j;
+        }
+    }
+    this->slots[hole] = Slot();
+    this->curr_size--;
+    if (8 * this->curr_size < this->capacity && this->capacity > this->min_capacity)
+        rehash(this->capacity / 2);
+    return true;
+}
+
+/**
+ * @brief Distribution of probe lengths over all stored keys.
+ * @return histogram[n] is the number of keys found at the n-th slot probed (n >= 1).
+ */
+template <typename key_t, typename value_t, typename hash_t>
+std::vector<unsigned int> HashTable<key_t, value_t, hash_t>::probe_length_histogram() const {
+    std::vector<unsigned int> histogram(1, 0);
+    for (unsigned int i = 0; i < this->capacity; i++) {
+        if (!this->slots[i].used)
+            continue;
+        std::size_t length = ((i - home(this->slots[i].key)) & (this->capacity - 1)) + 1;
+        if (histogram.size() <= length)
+            histogram.resize(length + 1, 0);
+        histogram[length]++;
+    }
+    return histogram;
+}
+
+/**
+ * @brief Non-owning view of a run of characters, valid as long as its storage is.
+ */
+struct StringRef {
+    const char* data;
+    std::size_t size;
+};
+
+/**
+ * @brief Location of a string inside a StringArena.
+ */
+struct ArenaKey {
+    uint32_t offset;
+    uint32_t len;
+};
+
+/**
+ * @brief Storage for the bytes of many strings, addressed by ArenaKey.
+ * Strings are appended at the end. Releasing one only counts its bytes as released: the
+ * arena cannot know who holds keys into it, so its owner compacts it by copying the live
+ * strings into a fresh arena (see Dictionary::remove) once released bytes dominate.
+ * Keys stay valid as the arena grows; pointers into it only until the next append.
+ */
+class StringArena {
+private:
+    std::vector<char> bytes;
+    std::size_t released_bytes = 0;
+public:
+    ArenaKey append(const char* str, std::size_t len);
+    void release(ArenaKey key) { this->released_bytes += key.len; }
+    const char* data(ArenaKey key) const { return this->bytes.data() + key.offset; }
+    std::size_t size() const { return this->bytes.size(); }
+    std::size_t released() const { return this->released_bytes; }
+    void reserve(std::size_t num_bytes) { this->bytes.reserve(num_bytes); }
+    void swap(StringArena& other);
+};
+
+/**
+ * @brief Key storage of a chained table whose chain nodes own their keys as std::string.
+ * 
+ * A key storage policy turns a key's characters into the stored key (store), gives them
+ * back (bytes), is told when a stored key is dropped (release), and reports the heap
+ * bytes a stored key holds beyond its chain node (heap_bytes).
+ */
+struct StringKeys {
+    using key_type = std::string;
+    StringRef bytes(const std::string& key) const { return StringRef{key.data(), key.size()}; }
+    std::string store(const char* str, std::size_t len) { return std::string(str, len); }
+    void release(const std::string&) {}
+    std::size_t heap_bytes(const std::string& key) const {
+        // keys that fit the small string buffer hold no heap memory
+        return key.capacity() > std::string().capacity() ? key.capacity() + 1 : 0;
+    }
+};
+
+/**
+ * @brief Key storage of a chained table whose chain nodes hold the location of their key
+ * in a StringArena owned by someone else, so each key's characters are stored once.
+ */
+struct ArenaKeys {
+    using key_type = ArenaKey;
+    StringArena* arena = nullptr;
+    StringRef bytes(ArenaKey key) const { return StringRef{this->arena->data(key), key.len}; }
+    ArenaKey store(const char* str, std::size_t len) { return this->arena->append(str, len); }
+    void release(ArenaKey key) { this->arena->release(key); }
+    std::size_t heap_bytes(ArenaKey) const { return 0; } // counted by the arena's owner
+};
+
+/**
+ * @brief Separate-chaining hash table with string keys, shared by HashTable<std::string, ...>
+ * and ArenaHashTable, which only differ in where the characters of a key are kept.
+ * 
+ * Chains are std::forward_list nodes, so rehashing splices nodes instead of copying pairs,
+ * and a pointer to a stored value stays valid until its key is removed. Keys may only hold
+ * letters. The table doubles once the load factor reaches threshold, synchronously by
+ * default or incrementally (set_incremental), and shrinks once it falls far below.
  * 
  * @tparam value_t The type of the value.
+ * @tparam hash_t The hash policy.
+ * @tparam keys_t The key storage policy, see StringKeys.
  */
-template<typename value_t>
-class HashTable<std::string, value_t> {
-    using ht_pair = std::pair<std::string, value_t>;
-private:
-    std::forward_list<ht_pair>* array;
-    unsigned int curr_size;
-    unsigned int capacity;
+template<typename value_t, typename hash_t, typename keys_t>
+class ChainedHashTable {
+protected:
+    using key_type = typename keys_t::key_type;
+    using ht_pair = std::pair<key_type, value_t>;
+    using chain_t = std::forward_list<ht_pair>;
+
+    // bucket arrays are raw allocations whose buckets are constructed and destroyed
+    // explicitly, so incremental mode can do both a few buckets at a time
+    std::forward_list<ht_pair>* array = nullptr;
+    unsigned int curr_size = 0;
+    unsigned int capacity = 0;
+    unsigned int min_capacity = 0; // shrink() never goes below the initial capacity
     double threshold = 0.8;
 
-    unsigned int hash(const std::string &str) const;
-    void double_size();
+    // Incremental resizing: while old_array is set, buckets [rehash_index, old_capacity)
+    // of the old array still hold pairs that have not been moved into array yet
+    static const unsigned int REHASH_STEP = 2; // buckets migrated per insert
+    static const unsigned int BUILD_STEP = 8; // buckets of the next array constructed per insert
+    bool incremental = false;
+    std::forward_list<ht_pair>* old_array = nullptr; // buckets below rehash_index are destroyed
+    unsigned int old_capacity = 0;
+    unsigned int rehash_index = 0;
+    std::forward_list<ht_pair>* next_array = nullptr; // 2 * capacity buckets, the first next_built constructed
+    unsigned int next_built = 0;
+
+    keys_t keys;
+#ifdef HASHTABLE_STATS
+    mutable HashTableCounters counters;
+#endif
+
+    ChainedHashTable() = default;
+    explicit ChainedHashTable(const unsigned int size);
+    ~ChainedHashTable();
+    static std::forward_list<ht_pair>* allocate_buckets(unsigned int num_buckets);
+    static void free_buckets(std::forward_list<ht_pair>* buckets, unsigned int first, unsigned int last);
+    void build_step(unsigned int num_buckets);
+    unsigned int bucket_of(const key_type& key, unsigned int num_buckets) const;
+    bool matches(const ht_pair& item, const char* key, std::size_t len) const;
+    void resize(unsigned int new_capacity);
+    void start_rehash();
+    void rehash_step(unsigned int num_buckets);
     inline double load_factor() const;
+    static bool valid_key(const char* str, std::size_t len);
+
+    /**
+     * @brief Advances a pending incremental resize, then checks that the key may be inserted.
+     * @return True if the key is valid and absent.
+     */
+    bool admits(const char* key, std::size_t len, uint64_t h);
+
+    /**
+     * @brief Links a new pair at the front of its chain and grows the table if needed.
+     * @param h The hash_key() of the key.
+     */
+    void link(uint64_t h, key_type&& key, const value_t& value);
+public:
+    ChainedHashTable(const ChainedHashTable& other) = delete;
+    ChainedHashTable& operator=(const ChainedHashTable& other) = delete;
+
+    static uint64_t hash_key(const char* key, std::size_t len) { return hash_t::hash(key, len); }
+
+    /**
+     * @brief Inserts (key, value) only if the key is absent.
+     * The stored key is only built once the key is known to be new, so a rejected
+     * insert performs no allocation.
+     * @return True if the pair was inserted, false if the key exists or is invalid.
+     */
+    bool try_emplace(const char* key, std::size_t len, const value_t& value);
+
+    /**
+     * @brief Looks up a key given as a character range, without building a std::string.
+     * @return A pointer to the stored value, or nullptr if the key is absent. The pointer
+     * stays valid until the key is removed (rehashing relinks nodes, it does not move them).
+     */
+    const value_t* find(const char* key, std::size_t len) const;
+
+    /**
+     * @brief find for a key whose hash_key() is already known.
+     */
+    const value_t* find(const char* key, std::size_t len, uint64_t h) const;
+
+    /**
+     * @brief Copies the value of a key into value if the key is present.
+     * @return True if the key was found; value is left untouched otherwise.
+     */
+    bool try_get(const char* key, std::size_t len, value_t& value) const;
+
+    /**
+     * @brief Unlinks the pair with the given key from its chain.
+     * Chains hold no tombstones, so a removal shortens the chain and later lookups never
+     * pay for it. The table shrinks once the load factor falls below threshold / 4.
+     * @return True if the key was present.
+     */
+    bool remove(const char* key, std::size_t len);
+
+    /**
+     * @brief Halves the capacity while the load factor is below threshold / 4, stopping
+     * once the load would reach threshold / 2 or the capacity would drop below its initial size.
+     * @return True if the table was resized.
+     */
+    bool shrink();
+    unsigned int get_size() const;
+    unsigned int get_max_size() const;
+
+    /**
+     * @brief Switches between synchronous and incremental resizing.
+     * 
+     * In incremental mode, every insert also constructs the next BUILD_STEP buckets of
+     * the doubled array ahead of time, so crossing the threshold only swaps it in. Both
+     * arrays are then kept, and every insert moves the next REHASH_STEP non-empty old
+     * buckets into the new array (as Redis does), destroying the old buckets as it goes,
+     * so no single insert pays for allocating, rehashing or freeing a whole array.
+     * Lookups check both arrays while a migration is in progress. Turning the mode off
+     * finishes any pending migration.
+     * 
+     * @param on True for incremental resizing, false for the default synchronous doubling.
+     */
+    void set_incremental(bool on);
+    bool is_rehashing() const;
+
+    /**
+     * @brief Distribution of chain lengths over all buckets.
+     * @return histogram[n] is the number of buckets holding exactly n pairs.
+     */
+    std::vector<unsigned int> chain_length_histogram() const;
+
+    /**
+     * @brief Activity counters (with -DHASHTABLE_STATS) and current layout.
+     */
+    HashTableStats stats() const;
+    void print(unsigned int k) const;
+    void debug_print(std::string prefix = "") const;
+};
+
+/**
+ * @brief A hash table template specialization for key-value pairs with string keys.
+ * 
+ * @tparam value_t The type of the value.
+ * @tparam hash_t The hash policy.
+ */
+template<typename value_t, typename hash_t>
+class HashTable<std::string, value_t, hash_t> : public ChainedHashTable<value_t, hash_t, StringKeys> {
+    using base_t = ChainedHashTable<value_t, hash_t, StringKeys>;
+    using ht_pair = std::pair<std::string, value_t>;
 public:
     HashTable() = default;
     HashTable(const unsigned int size);
-    HashTable(const HashTable& other) = delete;
-    ~HashTable();
     bool insert(const ht_pair& pair);
+    bool insert(ht_pair&& pair);
+    using base_t::try_emplace;
+    bool try_emplace(const std::string& key, const value_t& value);
+    using base_t::find;
+    const value_t* find(const std::string& key) const;
+    using base_t::try_get;
+    bool try_get(const std::string& key, value_t& value) const;
+    value_t get(const std::string& word) const;
+    value_t operator[](const std::string& word) const;
+    using base_t::remove;
+    bool remove(const std::string& word);
+};
+
+
+/**
+ * @brief An open-addressing hash table template for key-value pairs.
+ * 
+ * @tparam key_t The type of the key.
+ * @tparam value_t The type of the value.
+ * @tparam hash_t The hash policy. Only its 64-bit hash() is used: the table always has
+ * a power-of-two capacity and splits the hash into a probe start and a control byte.
+ */
+template<typename key_t, typename value_t, typename hash_t = WyHash>
+class FlatHashTable;
+
+/**
+ * @brief Open-addressing hash table with string keys, a drop-in for HashTable<std::string, value_t>.
+ * 
+ * Pairs are stored inline in one slot array instead of one heap node per entry. Next to
+ * the slots sits an array of control bytes (SwissTable layout): EMPTY, DELETED, or the low
+ * 7 bits of the key's hash for a full slot. Lookups compare a whole group of 16 control
+ * bytes against those 7 bits at once (SSE2 when available) and only touch the slots whose
+ * control byte matches, so most misses never compare a single string.
+ * 
+ * @tparam value_t The type of the value.
+ */
+template<typename value_t, typename hash_t>
+class FlatHashTable<std::string, value_t, hash_t> {
+    using ht_pair = std::pair<std::string, value_t>;
+private:
+    static const unsigned int GROUP_WIDTH = 16;
+    static const int8_t EMPTY = -128;
+    static const int8_t DELETED = -2;
+
+    int8_t* ctrl; // capacity + GROUP_WIDTH bytes, the first group is mirrored at the end
+    ht_pair* slots;
+    unsigned int curr_size;
+    unsigned int capacity; // power of two, at least GROUP_WIDTH
+    unsigned int growth_left; // inserts left before the table must grow
+    unsigned int min_capacity;
+
+    uint64_t hash(const std::string &str) const;
+    void set_ctrl(unsigned int i, int8_t c);
+    void allocate(unsigned int cap);
+    void rehash(unsigned int new_capacity);
+    int find_index(const std::string& word, uint64_t h) const;
+    unsigned int find_insert_slot(uint64_t h) const;
+public:
+    FlatHashTable(const unsigned int size);
+    FlatHashTable(const FlatHashTable& other) = delete;
+    ~FlatHashTable();
+    bool insert(const ht_pair& pair);
+
+    /**
+     * @brief Removes a key, leaving a DELETED marker only where one is needed.
+     * 
+     * A slot can go straight back to EMPTY when no probe could ever have passed over it,
+     * that is when the 16-byte windows before and after it have never all been full
+     * (the same test as absl's flat_hash_map). Otherwise it becomes DELETED so that
+     * probes continue past it. Tombstones still count against growth_left, so when the
+     * table runs out of room mostly because of them it is rebuilt at the same capacity
+     * instead of doubling, and probe lengths stay bounded however many keys come and go.
+     * 
+     * @return True if the key was present.
+     */
+    bool remove(const std::string& word);
+
+    /**
+     * @brief Rebuilds the table at a smaller power of two while the load is below a
+     * quarter of the maximum load, never going below its initial capacity.
+     * @return True if the table was resized.
+     */
+    bool shrink();
+
+    /**
+     * @brief Looks up a key without throwing.
+     * @return A pointer to the stored value, or nullptr if the key is absent. The pointer
+     * is invalidated by the next insert or remove, which may move the slots.
+     */
+    const value_t* find(const std::string& word) const;
+    bool try_get(const std::string& word, value_t& value) const;
     value_t get(const std::string& word) const;
     value_t operator[](const std::string& word) const;
-    HashTable& operator=(const HashTable& other) = delete;
+    FlatHashTable& operator=(const FlatHashTable& other) = delete;
     unsigned int get_size() const;
     unsigned int get_max_size() const;
-    bool remove(std::string word);
-    void print(unsigned int k) const;
-    void debug_print(std::string prefix = "") const;
+
+    /**
+     * @brief Distribution of probe lengths over all stored keys.
+     * @return histogram[n] is the number of keys found in the n-th group probed (n >= 1).
+     */
+    std::vector<unsigned int> probe_length_histogram() const;
+};
+
+
+/**
+ * @brief A chained hash table whose keys are strings stored in a StringArena.
+ * 
+ * Chains hold an 8-byte ArenaKey instead of a std::string, so each key's characters are
+ * stored once, in the arena, and can be shared with whoever owns the arena. Apart from
+ * where the key bytes live it is the same table as HashTable<std::string, value_t, hash_t>:
+ * same hash, same chain order and same resizing, so print(k) shows the same chains.
+ * 
+ * @tparam value_t The type of the value.
+ * @tparam hash_t The hash policy.
+ */
+template<typename value_t, typename hash_t = WyHash>
+class ArenaHashTable : public ChainedHashTable<value_t, hash_t, ArenaKeys> {
+    using base_t = ChainedHashTable<value_t, hash_t, ArenaKeys>;
+public:
+    ArenaHashTable() = default;
+
+    /**
+     * @param size The initial number of buckets.
+     * @param arena Storage for the key bytes, which must outlive the table.
+     */
+    ArenaHashTable(const unsigned int size, StringArena* arena);
+
+    /**
+     * @brief Appends the key to the arena and inserts (key, value) if the key is absent.
+     * @param key_out Set to the key's location in the arena when the pair is inserted.
+     * @return True if the pair was inserted, false if the key exists or is invalid.
+     */
+    bool try_emplace(const char* key, std::size_t len, const value_t& value, ArenaKey& key_out);
+
+    /**
+     * @brief try_emplace for a key whose hash_key() is already known.
+     */
+    bool try_emplace(const char* key, std::size_t len, uint64_t h, const value_t& value, ArenaKey& key_out);
+    using base_t::try_emplace;
+
+    /**
+     * @brief Replaces every stored key by relocate(key, value), for an owner that moved
+     * the key bytes to another arena. The bytes, and so the chains, must stay the same.
+     */
+    void relocate(const std::function<ArenaKey(ArenaKey, const value_t&)>& relocate);
+};
+
+
+/*
+ * On-disk layout of a VocabImage: the header, the token table (one ArenaKey per token,
+ * len 0 for token 0 and removed tokens), the hash index (index_capacity token numbers,
+ * 0 for an empty slot, linear probing on WyHash) and finally the word bytes. Everything
+ * is addressed by index or offset, so the file can be mapped at any address.
+ */
+struct VocabImageHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t num_tokens;
+    uint32_t index_capacity; // power of two
+    uint32_t pad;
+    uint64_t arena_size;
+};
+
+/**
+ * @brief Read-only vocabulary served directly from a memory-mapped file written by Dictionary::save.
+ * Opening validates the header, the token table and the index in one pass: nothing is
+ * hashed or copied, and lookups then never leave the mapping.
+ */
+class VocabImage {
+private:
+    static const char MAGIC[8];
+    static const uint32_t VERSION = 1;
+
+    MappedFile file;
+    const VocabImageHeader* header = nullptr;
+    const ArenaKey* words = nullptr;
+    const uint32_t* index = nullptr;
+    const char* arena = nullptr;
+public:
+    VocabImage() = default;
+    VocabImage(const VocabImage& other) = delete;
+    VocabImage& operator=(const VocabImage& other) = delete;
+
+    /**
+     * @brief Writes an image of a vocabulary.
+     * @param words The word of every token, len 0 for unused tokens; token 0 is never used.
+     * @param arena The storage words point into. Only the live words are written.
+     * @return False if the file could not be written.
+     */
+    static bool write(const std::string& filename, const std::vector<ArenaKey>& words, const StringArena& arena);
+
+    /**
+     * @brief Maps an image into memory.
+     * @return False if the file could not be opened or is not a valid image.
+     */
+    bool open(const std::string& filename);
+    void close();
+    bool is_open() const { return this->header != nullptr; }
+    uint32_t num_tokens() const { return this->header->num_tokens; }
+    int token(const char* word, std::size_t len) const;
+    StringRef ret_view(int token) const;
 };
 
 
 class Dictionary {
 private:
-    std::vector<std::string> words;
-    HashTable<std::string, int> hash_table;
+    // Each word's characters are stored once, in the arena; words and the hash table
+    // only hold its location
+    StringArena arena;
+    std::vector<ArenaKey> words; // removed tokens have len 0
+    std::vector<int> free_tokens; // removed tokens, reused by later inserts (most recent first)
+    // the assignment's hash keeps print(k) showing the chains the spec expects
+    ArenaHashTable<int, PolynomialHash> hash_table;
+    VocabImage image; // while open, lookups are answered from it and the dictionary is read-only
+
+    void compact_arena();
 
 public:
     Dictionary(unsigned int size);
     Dictionary() = default;
     Dictionary(const Dictionary& other) = delete;
     bool insert(const std::string & str);
-    int token(const std::string& word);
+    bool insert(const char* word, std::size_t len);
+
+    /**
+     * @brief Memory-maps a file and inserts each of its whitespace-separated words.
+     * Words already in the dictionary are rejected without building a string.
+     * @return True if at least one word was inserted, false otherwise or if the file could not be opened.
+     */
+    bool load(const std::string& filename);
+    bool remove(const std::string& word);
+
+    /**
+     * @brief Switches the word table between synchronous and incremental resizing, see
+     * ChainedHashTable::set_incremental. Tokens are unaffected; print(k) only shows the
+     * new bucket array while a migration is pending.
+     */
+    void set_incremental(bool on);
+    int token(const std::string& word) const;
+    int token(const char* word, std::size_t len) const;
+
+    /**
+     * @brief Tokenizes whitespace-separated text in a single pass.
+     * 
+     * Word boundaries are found 16 bytes at a time with SSE2 when available, and each
+     * word is looked up in place with the non-throwing find, so the whole call performs
+     * no per-word allocation. Unknown words produce -1, as token() does.
+     * 
+     * @param text The first byte of the text.
+     * @param len The number of bytes of the text.
+     * @param tokens The tokens are appended to this vector.
+     * @return The number of tokens appended.
+     */
+    std::size_t tokenize(const char* text, std::size_t len, std::vector<int32_t>& tokens) const;
+
+    /**
+     * @brief Tokenizes text into a caller-provided buffer, stopping once it is full.
+     * Call again with text + consumed to continue where the previous call stopped.
+     * @param consumed Set to the number of bytes processed, always at a word boundary.
+     * @return The number of tokens written, at most max_tokens.
+     */
+    std::size_t tokenize(const char* text, std::size_t len, int32_t* tokens, std::size_t max_tokens,
+                         std::size_t& consumed) const;
+
+    /**
+     * @brief Memory-maps a file and tokenizes its whole content.
+     * @return False if the file could not be opened.
+     */
+    bool tokenize_file(const std::string& filename, std::vector<int32_t>& tokens) const;
     std::string ret(const int& token);
+
+    /**
+     * @brief Retrieves the word of a token without copying it.
+     * @return A view into the dictionary's arena, or of "N/A" if the token does not exist.
+     * The view is invalidated by the next insert or remove.
+     */
+    StringRef ret_view(int token) const;
+
+    /**
+     * @brief One past the largest token handed out so far; token 0 is never used.
+     */
+    int num_tokens() const;
     void print(unsigned int k);
+    std::vector<unsigned int> chain_length_histogram() const;
+
+    /**
+     * @brief Statistics of the dictionary's hash table, with bytes covering the arena
+     * and token table as well.
+     */
+    HashTableStats stats() const;
+
+    /**
+     * @brief Writes the vocabulary to a file that open() can map.
+     * @return False if the file could not be written.
+     */
+    bool save(const std::string& filename) const;
+
+    /**
+     * @brief Serves token, ret and tokenize from a vocabulary file written by save(),
+     * without copying it. The in-memory words are kept but hidden until close().
+     * @return False if the file could not be opened or is not a vocabulary image.
+     */
+    bool open(const std::string& filename);
+    void close();
+};
+
+
+/**
+ * @brief A word-to-token dictionary that many threads can read and write at once.
+ * 
+ * Lookups take no lock. Words are split over num_shards shards by hash, and each shard is
+ * a linear-probing table of pointers to immutable entries. A writer locks only its shard,
+ * publishes a fully built entry with a release store, and grows a shard by building a
+ * bigger copy and publishing it the same way. Readers load the current table and the slots
+ * with acquire, so they always see complete entries. Replaced tables are kept until the
+ * dictionary is destroyed rather than freed, since a reader may still be probing one; they
+ * add up to less than the live tables. Tokens come from one atomic counter, and a
+ * lock-free two-level directory maps them back to their entries for ret.
+ * 
+ * Words cannot be removed, and the tokens of words inserted concurrently follow the
+ * order in which the inserts reach the counter.
+ */
+class ConcurrentDictionary {
+private:
+    struct Entry {
+        uint64_t hash;
+        int32_t token;
+        std::string word;
+    };
+    struct Table {
+        unsigned int capacity; // power of two
+        std::atomic<Entry*>* slots;
+    };
+    struct Shard {
+        std::mutex lock;
+        std::atomic<Table*> table;
+        unsigned int size; // guarded by lock
+        std::vector<Table*> retired; // guarded by lock
+        char pad[64]; // keeps the locks of neighbouring shards off one cache line
+    };
+
+    static const unsigned int CHUNK_BITS = 16;
+    static const unsigned int NUM_CHUNKS = 1u << 14; // room for 2^30 tokens
+
+    unsigned int num_shards; // power of two
+    std::unique_ptr<Shard[]> shards;
+    std::atomic<int32_t> next_token;
+    std::unique_ptr<std::atomic<std::atomic<Entry*>*>[]> chunks; // token -> entry, allocated as needed
+
+    static Table* new_table(unsigned int capacity);
+    Shard& shard_of(uint64_t h) const;
+    const Entry* find(const char* word, std::size_t len, uint64_t h) const;
+    void publish_token(Entry* entry);
+public:
+    /**
+     * @param num_shards Number of shards, rounded up to a power of two. More shards let
+     * more writers insert at once.
+     */
+    explicit ConcurrentDictionary(unsigned int num_shards = 64);
+    ConcurrentDictionary(const ConcurrentDictionary& other) = delete;
+    ConcurrentDictionary& operator=(const ConcurrentDictionary& other) = delete;
+    ~ConcurrentDictionary();
+
+    bool insert(const char* word, std::size_t len);
+    bool insert(const std::string& word);
+    int token(const char* word, std::size_t len) const;
+    int token(const std::string& word) const;
+    std::size_t tokenize(const char* text, std::size_t len, std::vector<int32_t>& tokens) const;
+
+    /**
+     * @brief Retrieves the word of a token without copying it.
+     * @return A view that stays valid for the lifetime of the dictionary, or of "N/A".
+     */
+    StringRef ret_view(int token) const;
+    std::string ret(int token) const;
+    unsigned int size() const;
+};
+
+
+/**
+ * @brief Subword tokenization of whitespace-separated text over the words of a Dictionary.
+ * 
+ * Every word of text is split into vocabulary pieces, so no input maps to -1: a byte
+ * that no piece covers becomes one of 256 byte tokens numbered right after the
+ * dictionary's own tokens (byte_token). Two modes are available:
+ *  - WORDPIECE: greedy longest match from the left. The pieces are found by walking a
+ *    byte trie built once from the vocabulary, so each step costs one edge lookup per
+ *    byte instead of one hash lookup per candidate length. The dictionary only holds
+ *    alphabetic words, so there is no separate "##" continuation vocabulary: every
+ *    piece may start or continue a word.
+ *  - BPE: a word of the vocabulary is emitted as its own token. Other words start from
+ *    single bytes and repeatedly merge the adjacent pair whose concatenation has the
+ *    lowest token, i.e. was added to the vocabulary first. This is how BPE vocabularies
+ *    encode their merge order, so a vocabulary trained by BPE and loaded in training
+ *    order reproduces its encoding. The parts are a linked list and the candidate merges
+ *    a heap, so a word of n bytes costs O(n log n) pair lookups, each done in place with
+ *    Dictionary::token without building strings.
+ * 
+ * The tokenizer copies the trie but not the words: rebuild it after the dictionary changes.
+ */
+class SubwordTokenizer {
+private:
+    struct TrieNode {
+        uint32_t first_edge;
+        uint16_t num_edges;
+        int32_t token; // -1 if no word ends here
+    };
+    struct TrieEdge {
+        uint8_t label;
+        uint32_t target;
+    };
+
+    const Dictionary& dict;
+    int32_t byte_base;
+    std::vector<TrieNode> nodes; // node 0 is the root
+    std::vector<TrieEdge> edges; // sorted by label within each node
+    uint32_t root_children[256]; // child of the root per byte, 0 if none
+
+    int64_t child(uint32_t node, uint8_t label) const;
+    void wordpiece(const char* word, std::size_t len, std::vector<int32_t>& tokens) const;
+    void bpe(const char* word, std::size_t len, std::vector<int32_t>& tokens) const;
+public:
+    enum Mode { WORDPIECE, BPE };
+
+    explicit SubwordTokenizer(const Dictionary& dict);
+
+    /**
+     * @brief Splits every whitespace-separated word of text into pieces.
+     * @param tokens The tokens are appended to this vector.
+     * @return The number of tokens appended.
+     */
+    std::size_t encode(const char* text, std::size_t len, std::vector<int32_t>& tokens, Mode mode) const;
+
+    int32_t byte_token(uint8_t byte) const { return this->byte_base + byte; }
+
+    /**
+     * @brief The bytes a token stands for: a dictionary word or a single byte.
+     */
+    StringRef piece(int32_t token) const;
 };
@@ -48,12 +48,24 @@ int main(){
             myg.delete_n(a);
         } else if (command == "path") {
             int a, b;
-            iss >> a >> b;
-            myg.path(a, b);
+            string mode;
+            iss >> a >> b >> mode;
+            myg.path(a, b, mode);
         } else if (command == "lowest") {
             int a, b;
-            iss >> a >> b;
-            myg.lowest(a, b);
+            string mode;
+            iss >> a >> b >> mode;
+            myg.lowest(a, b, mode);
+        } else if (command == "settled") {
+            myg.settled();
+        } else if (command == "matrix") {
+            string sources, targets, output;
+            iss >> sources >> targets >> output;
+            myg.matrix(sources, targets, output);
+        } else if (command == "preprocess") {
+            string mode;
+            iss >> mode;
+            myg.preprocess(mode);
         } else if (command == "exit") {
             break;
         }
@@ -3,6 +3,118 @@
 #include <fstream>
 #include <queue>
 #include <algorithm>
+#include <limits>
+#include <iomanip>
+#include <cmath>
+#include <thread>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+
+/**
+ * @brief Rebuilds the CSR arrays from the adjacency map and clears the delta.
+ * Rows keep the iteration order of the map, so searches relax edges in the same order
+ * whether a node is read from here or from the map.
+ * @param g The adjacency map.
+ */
+void CompiledGraph::compile(const unordered_map<int, unordered_map<int, Edge>>& g) {
+    this->ids.clear();
+    this->index.clear();
+    this->ids.reserve(g.size());
+    this->index.reserve(g.size());
+    for (const auto& node : g) {
+        this->index[node.first] = this->ids.size();
+        this->ids.push_back(node.first);
+    }
+
+    this->offsets.assign(1, 0);
+    this->targets.clear();
+    this->weights.clear();
+    for (int id : this->ids) {
+        for (const auto& edge : g.at(id)) {
+            this->targets.push_back(this->index[edge.first]);
+            this->weights.push_back(edge.second.d / (edge.second.s * edge.second.a));
+        }
+        this->offsets.push_back(this->targets.size());
+    }
+
+    this->dirty.assign(this->ids.size(), 0);
+    this->num_dirty = 0;
+    this->stale = false;
+}
+
+/**
+ * @brief Marks the edges of node a as changed, adding a to the dense indices if it is new.
+ * @param a The node ID.
+ */
+void CompiledGraph::touch(int a) {
+    if (this->stale)
+        return;
+    auto it = this->index.find(a);
+    if (it == this->index.end()) {
+        // new nodes have no CSR row, they stay dirty until the next compile
+        this->index[a] = this->ids.size();
+        this->ids.push_back(a);
+        this->dirty.push_back(1);
+        this->num_dirty++;
+    } else if (!this->dirty[it->second]) {
+        this->dirty[it->second] = 1;
+        this->num_dirty++;
+    }
+    if (this->num_dirty > 64 && this->num_dirty > this->ids.size() / 8)
+        this->stale = true;
+}
+
+/**
+ * @brief Records the new weight of edge a -> b. The CSR row is patched in place if it already
+ * holds the edge, otherwise node a is marked dirty.
+ * @param a The source node ID.
+ * @param b The target node ID.
+ * @param weight The new travel time d / (s * a).
+ * @return True if the edge was patched in place, i.e. the structure of the copy is unchanged.
+ */
+bool CompiledGraph::update_edge(int a, int b, double weight) {
+    if (this->stale)
+        return false;
+    auto from = this->index.find(a);
+    auto to = this->index.find(b);
+    const bool known_target = to != this->index.end();
+    if (from != this->index.end() && known_target && !this->dirty[from->second]) {
+        for (unsigned int e = this->offsets[from->second]; e < this->offsets[from->second + 1]; e++) {
+            if (this->targets[e] == to->second) {
+                this->weights[e] = weight;
+                return true;
+            }
+        }
+    }
+    // a new edge: a's row must be rebuilt, b only needs a dense index
+    this->touch(a);
+    if (!known_target)
+        this->touch(b);
+    return false;
+}
+
+/**
+ * @brief Keeps the hierarchy and landmarks in step with a change of edge a - b. A customizable
+ * hierarchy survives changes of edge weights and is customized again by the next query, any
+ * other hierarchy is dropped. Landmark distances stay valid A* bounds while weights only grow,
+ * so they are measured again only after a weight decreased, and new landmarks are only
+ * picked once the edges themselves changed.
+ * @param in_place True if the compiled graph took the change as a weight patch.
+ * @param decreased True if the edge is new or its weight went down.
+ * @param a The node ID of one end.
+ * @param b The node ID of the other end.
+ */
+void Graph::weights_changed(bool in_place, bool decreased, int a, int b) {
+    if (!in_place)
+        this->num_landmarks = 0;
+    else if (decreased)
+        this->landmarks_stale = true;
+    if (in_place && this->ch.is_customizable())
+        this->ch.weights_changed(this->compiled.index[a], this->compiled.index[b]);
+    else
+        this->ch.clear();
+}
 
 bool Graph::edge_exists(int a, int b) {
     bool ab_exists = g.find(a) != g.end() && g[a].find(b) != g[a].end();
@@ -14,13 +126,876 @@ bool Graph::node_exists(int a) {
     return g.find(a) != g.end();
 }
 
+namespace {
+
+/**
+ * @brief Arc of the graph under contraction. Roads are undirected, so each arc is kept at both ends.
+ */
+struct ContractionArc{
+    int to;
+    double weight;
+    int middle;
+};
+
+typedef vector<vector<ContractionArc>> ContractionGraph;
+
+/**
+ * @brief Adds the arc to the list, or lowers the weight of an existing arc to the same node.
+ */
+void set_arc(vector<ContractionArc>& arcs, int to, double weight, int middle) {
+    for (auto& arc : arcs) {
+        if (arc.to == to) {
+            if (weight < arc.weight) {
+                arc.weight = weight;
+                arc.middle = middle;
+            }
+            return;
+        }
+    }
+    arcs.push_back(ContractionArc{to, weight, middle});
+}
+
+/**
+ * @brief Bounded Dijkstra used to look for witness paths around a node being contracted.
+ */
+class WitnessSearch{
+public:
+    vector<double> dist;
+    vector<int> touched;
+    vector<char> is_target;
+    vector<pair<double, int>> heap; // kept between runs to reuse its memory
+
+    /**
+     * @brief Searches from source without entering skip, until limit is exceeded,
+     * more than max_scanned arcs were scanned or all num_targets marked targets are settled.
+     * Distances not reached stay at infinity.
+     */
+    void run(const ContractionGraph& graph, int source, int skip, double limit, unsigned int max_scanned,
+             unsigned int num_targets) {
+        for (int v : this->touched)
+            this->dist[v] = numeric_limits<double>::infinity();
+        this->touched.clear();
+
+        auto later = greater<pair<double, int>>();
+        this->heap.clear();
+        this->dist[source] = 0;
+        this->touched.push_back(source);
+        this->heap.push_back({0, source});
+        unsigned int scanned = 0;
+        while (!this->heap.empty()) {
+            double d = this->heap.front().first;
+            int u = this->heap.front().second;
+            pop_heap(this->heap.begin(), this->heap.end(), later);
+            this->heap.pop_back();
+            if (d > this->dist[u])
+                continue;
+            if (d > limit || scanned > max_scanned)
+                break;
+            if (this->is_target[u] && --num_targets == 0)
+                break;
+            scanned += graph[u].size();
+            for (const auto& arc : graph[u]) {
+                if (arc.to == skip)
+                    continue;
+                if (d + arc.weight < this->dist[arc.to]) {
+                    if (this->dist[arc.to] == numeric_limits<double>::infinity())
+                        this->touched.push_back(arc.to);
+                    this->dist[arc.to] = d + arc.weight;
+                    this->heap.push_back({this->dist[arc.to], arc.to});
+                    push_heap(this->heap.begin(), this->heap.end(), later);
+                }
+            }
+        }
+    }
+};
+
+// arcs scanned after which a witness search gives up, when estimating and when contracting.
+// Giving up early only costs superfluous shortcuts, and a budget in arcs rather than nodes
+// keeps the searches cheap once the last, densely connected nodes are contracted.
+const unsigned int ESTIMATE_SCANNED = 40;
+const unsigned int CONTRACT_SCANNED = 2000;
+
+/**
+ * @brief Counts, and with apply adds, the shortcuts needed to contract v.
+ * @return The number of neighbour pairs without a witness path.
+ */
+int contract(ContractionGraph& graph, WitnessSearch& witness, int v, bool apply) {
+    const vector<ContractionArc>& arcs = graph[v];
+    int shortcuts = 0;
+    for (std::size_t i = 0; i + 1 < arcs.size(); i++) {
+        double limit = 0;
+        for (std::size_t j = i + 1; j < arcs.size(); j++) {
+            limit = max(limit, arcs[i].weight + arcs[j].weight);
+            witness.is_target[arcs[j].to] = 1;
+        }
+        witness.run(graph, arcs[i].to, v, limit, apply ? CONTRACT_SCANNED : ESTIMATE_SCANNED, arcs.size() - i - 1);
+        for (std::size_t j = i + 1; j < arcs.size(); j++)
+            witness.is_target[arcs[j].to] = 0;
+        for (std::size_t j = i + 1; j < arcs.size(); j++) {
+            double weight = arcs[i].weight + arcs[j].weight;
+            if (witness.dist[arcs[j].to] <= weight)
+                continue;
+            shortcuts++;
+            if (apply) {
+                set_arc(graph[arcs[i].to], arcs[j].to, weight, v);
+                set_arc(graph[arcs[j].to], arcs[i].to, weight, v);
+            }
+        }
+    }
+    return shortcuts;
+}
+
+} // namespace
+
+/**
+ * @brief Contracts every node of the graph and stores the upward arcs.
+ * The graph must be freshly compiled, without dirty nodes. Edges that cannot be
+ * travelled (traffic factor 0) and self-loops are left out.
+ * @param graph The compiled graph.
+ */
+void ContractionHierarchy::build(const CompiledGraph& graph) {
+    const int n = graph.size();
+    ContractionGraph remaining(n);
+    for (int u = 0; u < n; u++) {
+        for (unsigned int e = graph.offsets[u]; e < graph.offsets[u + 1]; e++) {
+            int v = graph.targets[e];
+            double weight = graph.weights[e];
+            if (v == u || !(weight < numeric_limits<double>::infinity()))
+                continue;
+            set_arc(remaining[u], v, weight, -1);
+            set_arc(remaining[v], u, weight, -1);
+        }
+    }
+
+    WitnessSearch witness;
+    witness.dist.assign(n, numeric_limits<double>::infinity());
+    witness.is_target.assign(n, 0);
+    vector<int> deleted_neighbours(n, 0);
+    vector<int> level(n, 0);
+    // twice the edge difference, plus the contracted neighbours and the depth below v,
+    // which spread the contraction evenly over the graph
+    auto priority = [&](int v) {
+        return 2 * (contract(remaining, witness, v, false) - static_cast<int>(remaining[v].size())) + deleted_neighbours[v] + level[v];
+    };
+
+    // lazy updates: a node is contracted only if its recomputed priority is still the lowest
+    priority_queue<pair<int, int>, vector<pair<int, int>>, greater<pair<int, int>>> order;
+    for (int v = 0; v < n; v++)
+        order.push({priority(v), v});
+    ContractionGraph upward(n);
+    while (!order.empty()) {
+        int v = order.top().second;
+        order.pop();
+        int p = priority(v);
+        if (!order.empty() && p > order.top().first) {
+            order.push({p, v});
+            continue;
+        }
+
+        contract(remaining, witness, v, true);
+        upward[v].swap(remaining[v]);
+        for (const auto& arc : upward[v]) {
+            auto& arcs = remaining[arc.to];
+            for (std::size_t i = 0; i < arcs.size(); i++) {
+                if (arcs[i].to == v) {
+                    arcs[i] = arcs.back();
+                    arcs.pop_back();
+                    break;
+                }
+            }
+            deleted_neighbours[arc.to]++;
+            level[arc.to] = max(level[arc.to], level[v] + 1);
+        }
+    }
+
+    this->offsets.assign(1, 0);
+    this->arcs.clear();
+    for (int v = 0; v < n; v++) {
+        for (const auto& arc : upward[v])
+            this->arcs.push_back(Arc{arc.to, arc.weight, arc.middle});
+        this->offsets.push_back(this->arcs.size());
+    }
+
+    this->customizable = false;
+    this->allocate_queries(n);
+}
+
+namespace {
+
+const unsigned int DISSECTION_LEAF = 32;
+
+/**
+ * @brief Contraction order by nested dissection, which keeps the fill-in of a road network
+ * small without looking at weights. A piece of the graph is split along a breadth-first level
+ * of a pseudo-peripheral node. Of the levels that leave each side with at least a fifth of
+ * the piece, the one with the fewest nodes per pair of nodes it separates is chosen, which
+ * gives about 4% fewer arcs than the smallest level with a third on each side. The level
+ * becomes a separator ranked above both sides, which are split in turn, down to pieces of
+ * DISSECTION_LEAF nodes.
+ * @param graph The compiled graph.
+ * @return The nodes, lowest rank first.
+ */
+vector<int> dissection_order(const CompiledGraph& graph) {
+    const int n = graph.size();
+    vector<int> order(n);
+    int next_rank = n; // ranks are handed out from the top down
+    vector<int> piece(n, 0); // the piece a node belongs to, -1 once it is ranked
+    vector<int> depth(n, -1);
+    int num_pieces = 1;
+
+    auto bfs = [&](int start, vector<int>& reached) {
+        const int id = piece[start];
+        reached.assign(1, start);
+        depth[start] = 0;
+        for (std::size_t i = 0; i < reached.size(); i++) {
+            int u = reached[i];
+            for (unsigned int e = graph.offsets[u]; e < graph.offsets[u + 1]; e++) {
+                int v = graph.targets[e];
+                if (piece[v] == id && depth[v] < 0) {
+                    depth[v] = depth[u] + 1;
+                    reached.push_back(v);
+                }
+            }
+        }
+    };
+
+    vector<vector<int>> pending;
+    if (n > 0) {
+        pending.emplace_back(n);
+        for (int v = 0; v < n; v++)
+            pending.back()[v] = v;
+    }
+    vector<int> reached;
+    while (!pending.empty()) {
+        vector<int> nodes;
+        nodes.swap(pending.back());
+        pending.pop_back();
+        if (nodes.size() <= DISSECTION_LEAF) {
+            for (int v : nodes) {
+                order[--next_rank] = v;
+                piece[v] = -1;
+            }
+            continue;
+        }
+
+        bfs(nodes[0], reached);
+        if (reached.size() < nodes.size()) {
+            // the component of nodes[0] and the rest are already separated
+            vector<int> rest;
+            for (int v : nodes) {
+                if (depth[v] < 0)
+                    rest.push_back(v);
+            }
+            for (int v : reached) {
+                depth[v] = -1;
+                piece[v] = num_pieces;
+            }
+            num_pieces++;
+            pending.push_back(rest);
+            pending.push_back(reached);
+            continue;
+        }
+        int far = reached.back();
+        for (int v : reached)
+            depth[v] = -1;
+        bfs(far, reached);
+
+        vector<unsigned int> level_size(depth[reached.back()] + 1, 0);
+        for (int v : reached)
+            level_size[depth[v]]++;
+        int cut = -1;
+        unsigned int below = 0, median = 0;
+        double best = 0;
+        for (std::size_t l = 0; l < level_size.size(); l++) {
+            const unsigned int above = nodes.size() - below - level_size[l];
+            const double separated = static_cast<double>(below) * above / level_size[l];
+            if (below * 5 >= nodes.size() && above * 5 >= nodes.size() && separated > best) {
+                best = separated;
+                cut = l;
+            }
+            if (below * 2 < nodes.size())
+                median = l;
+            below += level_size[l];
+        }
+        if (cut < 0)
+            cut = median;
+
+        vector<int> side[2];
+        for (int v : reached) {
+            if (depth[v] == cut) {
+                order[--next_rank] = v;
+                piece[v] = -1;
+            } else {
+                side[depth[v] > cut].push_back(v);
+            }
+        }
+        for (int v : reached)
+            depth[v] = -1;
+        for (int k = 0; k < 2; k++) {
+            for (int v : side[k])
+                piece[v] = num_pieces;
+            num_pieces++;
+            if (!side[k].empty())
+                pending.push_back(side[k]);
+        }
+    }
+    return order;
+}
+
+} // namespace
+
+/**
+ * @brief Contracts every node of the graph in nested dissection order, keeping all fill-in arcs,
+ * and prepares the levels customize() works through. Unlike build(), every edge is kept,
+ * including those that cannot be travelled now, since traffic may change their weight.
+ * The arc weights are computed by the first customize().
+ * @param graph The compiled graph, without dirty nodes.
+ */
+void ContractionHierarchy::build_customizable(const CompiledGraph& graph) {
+    const int n = graph.size();
+    vector<vector<int>> remaining(n);
+    for (int u = 0; u < n; u++) {
+        for (unsigned int e = graph.offsets[u]; e < graph.offsets[u + 1]; e++) {
+            if (graph.targets[e] != u)
+                remaining[u].push_back(graph.targets[e]);
+        }
+    }
+
+    // contracting a node joins its higher-ranked neighbours into a clique
+    vector<int> rank_order = dissection_order(graph);
+    this->rank.resize(n);
+    for (int r = 0; r < n; r++)
+        this->rank[rank_order[r]] = r;
+    vector<char> marked(n, 0);
+    vector<vector<int>> upward(n);
+    for (int v : rank_order) {
+        const vector<int>& neighbours = remaining[v];
+        for (int x : neighbours) {
+            for (int y : remaining[x])
+                marked[y] = 1;
+            for (int y : neighbours) {
+                if (y != x && !marked[y])
+                    remaining[x].push_back(y);
+            }
+            for (int y : remaining[x])
+                marked[y] = 0;
+        }
+        upward[v].swap(remaining[v]);
+        for (int x : upward[v]) {
+            auto& arcs = remaining[x];
+            arcs.erase(find(arcs.begin(), arcs.end(), v));
+        }
+    }
+
+    // arcs sorted by target, with the compiled edge each one starts from
+    vector<int> edge_of(n, -1);
+    this->offsets.assign(1, 0);
+    this->arcs.clear();
+    this->arc_edge.clear();
+    for (int v = 0; v < n; v++) {
+        for (unsigned int e = graph.offsets[v]; e < graph.offsets[v + 1]; e++)
+            edge_of[graph.targets[e]] = e;
+        sort(upward[v].begin(), upward[v].end());
+        for (int w : upward[v]) {
+            this->arcs.push_back(Arc{w, numeric_limits<double>::infinity(), -1});
+            this->arc_edge.push_back(edge_of[w]);
+        }
+        for (unsigned int e = graph.offsets[v]; e < graph.offsets[v + 1]; e++)
+            edge_of[graph.targets[e]] = -1;
+        this->offsets.push_back(this->arcs.size());
+    }
+
+    // arcs from below, and levels: a node is one level above its highest lower neighbour
+    vector<unsigned int> count(n + 1, 0);
+    for (int u = 0; u < n; u++) {
+        for (unsigned int e = this->offsets[u]; e < this->offsets[u + 1]; e++)
+            count[this->arcs[e].to + 1]++;
+    }
+    for (int v = 0; v < n; v++)
+        count[v + 1] += count[v];
+    this->down_offsets = count;
+    this->down.resize(this->arcs.size());
+    for (int u = 0; u < n; u++) {
+        for (unsigned int e = this->offsets[u]; e < this->offsets[u + 1]; e++)
+            this->down[count[this->arcs[e].to]++] = {u, static_cast<int>(e)};
+    }
+
+    vector<unsigned int> level(n, 0);
+    unsigned int num_levels = 0;
+    for (int v : rank_order) {
+        for (unsigned int i = this->down_offsets[v]; i < this->down_offsets[v + 1]; i++)
+            level[v] = max(level[v], level[this->down[i].first] + 1);
+        num_levels = max(num_levels, level[v] + 1);
+    }
+    this->level_offsets.assign(num_levels + 1, 0);
+    for (int v = 0; v < n; v++)
+        this->level_offsets[level[v] + 1]++;
+    for (unsigned int l = 0; l < num_levels; l++)
+        this->level_offsets[l + 1] += this->level_offsets[l];
+    this->by_level.resize(n);
+    vector<unsigned int> next(this->level_offsets.begin(), this->level_offsets.end() - 1);
+    for (int v = 0; v < n; v++)
+        this->by_level[next[level[v]]++] = v;
+
+    this->customizable = true;
+    this->customized = false;
+    this->base_changed.assign(n, 1);
+    this->arcs_changed.assign(n, 0);
+    this->changed_edges.clear();
+    this->sweep_needed = true;
+    this->arc_queued.assign(this->arcs.size(), 0);
+    this->scratch.clear();
+    this->allocate_queries(n);
+}
+
+/**
+ * @brief Notes that the weight of the edge between dense nodes a and b changed, so the
+ * next customize() must recompute the arcs built on it.
+ */
+void ContractionHierarchy::weights_changed(int a, int b) {
+    const std::size_t ARC_BY_ARC = 256;
+    this->base_changed[a] = 1;
+    this->base_changed[b] = 1;
+    this->customized = false;
+    if (this->changed_edges.size() < ARC_BY_ARC)
+        this->changed_edges.push_back({a, b});
+    else
+        this->sweep_needed = true;
+}
+
+/**
+ * @brief Index of the arc between dense nodes a and b, stored at the lower-ranked one, or -1.
+ * Customizable hierarchies keep the arcs of each node sorted by target.
+ */
+int ContractionHierarchy::arc_between(int a, int b) const {
+    if (this->rank[a] > this->rank[b])
+        swap(a, b);
+    auto first = this->arcs.begin() + this->offsets[a];
+    auto last = this->arcs.begin() + this->offsets[a + 1];
+    auto it = lower_bound(first, last, b, [](const Arc& arc, int to) { return arc.to < to; });
+    return it != last && it->to == b ? static_cast<int>(it - this->arcs.begin()) : -1;
+}
+
+/**
+ * @brief Resets the arcs of v to their own edge weights if an edge behind them or an arc of a
+ * lower neighbour changed, keeping the old weights and filling the slots of the arcs.
+ * @return False if v can be skipped.
+ */
+bool ContractionHierarchy::begin_node(const CompiledGraph& graph, int v, Scratch& scratch) {
+    bool stale = this->base_changed[v];
+    for (unsigned int d = this->down_offsets[v]; !stale && d < this->down_offsets[v + 1]; d++)
+        stale = this->arcs_changed[this->down[d].first];
+    this->arcs_changed[v] = 0;
+    if (!stale)
+        return false;
+
+    scratch.old_weights.clear();
+    for (unsigned int e = this->offsets[v]; e < this->offsets[v + 1]; e++) {
+        Arc& arc = this->arcs[e];
+        scratch.old_weights.push_back(arc.weight);
+        arc.weight = this->arc_edge[e] >= 0 ? graph.weights[this->arc_edge[e]] : numeric_limits<double>::infinity();
+        arc.middle = -1;
+        scratch.slot[arc.to] = e - this->offsets[v];
+    }
+    return true;
+}
+
+/**
+ * @brief Lowers out[k], the k-th arc v -> w of v, to every path v - u - w through the lower
+ * neighbours u in down[first] .. down[last - 1]. Only reads the hierarchy.
+ * @param slot The position of the arc of v to each node, -1 for none.
+ */
+void ContractionHierarchy::lower_triangles(int v, unsigned int first, unsigned int last, const vector<int>& slot,
+                                           Arc* out) const {
+    for (unsigned int d = first; d < last; d++) {
+        const int u = this->down[d].first;
+        const double to_v = this->arcs[this->down[d].second].weight;
+        for (unsigned int e = this->offsets[u]; e < this->offsets[u + 1]; e++) {
+            // arcs to nodes below v belong to those nodes
+            const int k = slot[this->arcs[e].to];
+            if (k < 0)
+                continue;
+            if (to_v + this->arcs[e].weight < out[k].weight) {
+                out[k].weight = to_v + this->arcs[e].weight;
+                out[k].middle = u;
+            }
+        }
+    }
+}
+
+/**
+ * @brief Clears the slots of v and notes whether any of its arc weights changed.
+ */
+void ContractionHierarchy::end_node(int v, Scratch& scratch) {
+    for (unsigned int e = this->offsets[v]; e < this->offsets[v + 1]; e++) {
+        scratch.slot[this->arcs[e].to] = -1;
+        if (this->arcs[e].weight != scratch.old_weights[e - this->offsets[v]])
+            this->arcs_changed[v] = 1;
+    }
+}
+
+/**
+ * @brief Recomputes the weight and middle node of every upward arc of the given nodes from
+ * the compiled edge weights and the arcs of lower nodes, which must be final already.
+ * An arc v -> w is the cheaper of its own edge and every path v - u - w through a common
+ * lower neighbour u, so a node whose edges and lower neighbours are unchanged is skipped.
+ * @param scratch Scratch of the calling thread, with slot holding -1 for every node.
+ */
+void ContractionHierarchy::customize_nodes(const CompiledGraph& graph, const int* nodes, unsigned int count,
+                                           Scratch& scratch) {
+    for (unsigned int i = 0; i < count; i++) {
+        const int v = nodes[i];
+        if (!this->begin_node(graph, v, scratch))
+            continue;
+        this->lower_triangles(v, this->down_offsets[v], this->down_offsets[v + 1], scratch.slot,
+                              this->arcs.data() + this->offsets[v]);
+        this->end_node(v, scratch);
+    }
+}
+
+/**
+ * @brief customize_nodes for a single node, with its lower neighbours split between threads.
+ * Each thread keeps the best triangle of its share for every arc; merging the shares in order
+ * with strict comparisons picks the same triangles as a single thread would.
+ */
+void ContractionHierarchy::customize_split(const CompiledGraph& graph, int v, unsigned int num_threads) {
+    if (!this->begin_node(graph, v, this->scratch[0]))
+        return;
+    const unsigned int num_arcs = this->offsets[v + 1] - this->offsets[v];
+    const unsigned int first = this->down_offsets[v];
+    const unsigned int count = this->down_offsets[v + 1] - first;
+    const unsigned int chunk = (count + num_threads - 1) / num_threads;
+    auto share = [&](unsigned int t) {
+        vector<Arc>& out = this->scratch[t].candidates;
+        out.assign(num_arcs, Arc{-1, numeric_limits<double>::infinity(), -1});
+        this->lower_triangles(v, first + t * chunk, first + min(count, (t + 1) * chunk), this->scratch[0].slot,
+                              out.data());
+    };
+    vector<thread> workers;
+    for (unsigned int t = 1; t < num_threads && t * chunk < count; t++)
+        workers.emplace_back(share, t);
+    share(0);
+    for (auto& worker : workers)
+        worker.join();
+
+    for (unsigned int t = 0; t < num_threads && t * chunk < count; t++) {
+        for (unsigned int k = 0; k < num_arcs; k++) {
+            Arc& arc = this->arcs[this->offsets[v] + k];
+            if (this->scratch[t].candidates[k].weight < arc.weight) {
+                arc.weight = this->scratch[t].candidates[k].weight;
+                arc.middle = this->scratch[t].candidates[k].middle;
+            }
+        }
+    }
+    this->end_node(v, this->scratch[0]);
+}
+
+/**
+ * @brief Brings the hierarchy up to date after a few edge changes by following the changed
+ * arcs instead of sweeping every level. An arc x -> y is recomputed from its edge and its
+ * lower triangles x - u - y, found by merging the lower neighbour lists of x and y, which are
+ * sorted by node. If its weight changed, every arc y - z with z above x uses it in a lower
+ * triangle, and is queued in turn if that triangle was its weight before or is no heavier
+ * now. Arcs are taken lowest tail rank first, so the arcs a triangle reads are always final.
+ * @param graph The compiled graph the hierarchy was built from.
+ */
+void ContractionHierarchy::customize_arcs(const CompiledGraph& graph) {
+    typedef pair<int, int> QueuedArc; // (rank of the tail, arc)
+    priority_queue<QueuedArc, vector<QueuedArc>, greater<QueuedArc>> queue;
+    auto push = [&](int arc, int from) {
+        if (arc >= 0 && !this->arc_queued[arc]) {
+            this->arc_queued[arc] = 1;
+            queue.push({this->rank[from], arc});
+        }
+    };
+    // the tail of a queued arc is the node whose row holds it
+    auto tail_of = [&](int arc) {
+        return static_cast<int>(upper_bound(this->offsets.begin(), this->offsets.end(), static_cast<unsigned int>(arc))
+                                - this->offsets.begin()) - 1;
+    };
+    for (const auto& edge : this->changed_edges) {
+        const int arc = this->arc_between(edge.first, edge.second);
+        if (arc >= 0)
+            push(arc, tail_of(arc));
+    }
+
+    while (!queue.empty()) {
+        const int e = queue.top().second;
+        queue.pop();
+        this->arc_queued[e] = 0;
+        const int x = tail_of(e);
+        const int y = this->arcs[e].to;
+
+        double weight = this->arc_edge[e] >= 0 ? graph.weights[this->arc_edge[e]] : numeric_limits<double>::infinity();
+        int middle = -1;
+        unsigned int i = this->down_offsets[x], j = this->down_offsets[y];
+        while (i < this->down_offsets[x + 1] && j < this->down_offsets[y + 1]) {
+            const int u = this->down[i].first;
+            if (u < this->down[j].first) {
+                i++;
+            } else if (u > this->down[j].first) {
+                j++;
+            } else {
+                const double through = this->arcs[this->down[i].second].weight + this->arcs[this->down[j].second].weight;
+                if (through < weight) {
+                    weight = through;
+                    middle = u;
+                }
+                i++;
+                j++;
+            }
+        }
+        const double old_weight = this->arcs[e].weight;
+        this->arcs[e].weight = weight;
+        this->arcs[e].middle = middle;
+        if (weight == old_weight)
+            continue;
+        // arcs y - z above y are stored at y, sorted by z like those of x
+        unsigned int g = this->offsets[y];
+        for (unsigned int f = this->offsets[x]; f < this->offsets[x + 1]; f++) {
+            const int z = this->arcs[f].to;
+            if (z == y)
+                continue;
+            int between;
+            if (this->rank[z] < this->rank[y]) {
+                between = this->arc_between(z, y);
+            } else {
+                while (this->arcs[g].to != z)
+                    g++;
+                between = g;
+            }
+            // only an arc this triangle was the best path of, or may now be, can change
+            const double other = this->arcs[f].weight;
+            if (old_weight + other == this->arcs[between].weight || weight + other <= this->arcs[between].weight)
+                push(between, this->rank[y] < this->rank[z] ? y : z);
+        }
+    }
+}
+
+/**
+ * @brief Brings the arc weights of a customizable hierarchy up to date with the compiled
+ * edge weights. A few changed edges are followed arc by arc. Otherwise the levels are
+ * processed bottom up: the nodes of a wide level are split between threads, each writing
+ * only the arcs of its own nodes, and an expensive node of a narrow level, such as the
+ * separator cliques at the top, has its lower neighbours split between threads instead.
+ * @param graph The compiled graph the hierarchy was built from.
+ */
+void ContractionHierarchy::customize(const CompiledGraph& graph) {
+    const unsigned int PARALLEL_LEVEL = 1024;
+    const unsigned int PARALLEL_NODE = 1 << 16; // triangles to look at before a node is split
+    unsigned int num_threads = max(1u, thread::hardware_concurrency());
+    if (this->scratch.size() != num_threads) {
+        this->scratch.assign(num_threads, Scratch());
+        for (auto& thread_scratch : this->scratch)
+            thread_scratch.slot.assign(graph.size(), -1);
+    }
+
+    if (!this->sweep_needed) {
+        this->customize_arcs(graph);
+        for (const auto& edge : this->changed_edges) {
+            this->base_changed[edge.first] = 0;
+            this->base_changed[edge.second] = 0;
+        }
+        this->changed_edges.clear();
+        this->customized = true;
+        return;
+    }
+
+    for (unsigned int l = 0; l + 1 < this->level_offsets.size(); l++) {
+        const int* nodes = this->by_level.data() + this->level_offsets[l];
+        const unsigned int count = this->level_offsets[l + 1] - this->level_offsets[l];
+        if (num_threads == 1) {
+            this->customize_nodes(graph, nodes, count, this->scratch[0]);
+        } else if (count < PARALLEL_LEVEL) {
+            for (unsigned int i = 0; i < count; i++) {
+                const int v = nodes[i];
+                unsigned int work = 0;
+                for (unsigned int d = this->down_offsets[v]; d < this->down_offsets[v + 1]; d++)
+                    work += this->offsets[this->down[d].first + 1] - this->offsets[this->down[d].first];
+                if (work >= PARALLEL_NODE)
+                    this->customize_split(graph, v, num_threads);
+                else
+                    this->customize_nodes(graph, &v, 1, this->scratch[0]);
+            }
+        } else {
+            vector<thread> workers;
+            const unsigned int chunk = (count + num_threads - 1) / num_threads;
+            for (unsigned int t = 1; t < num_threads && t * chunk < count; t++) {
+                workers.emplace_back(&ContractionHierarchy::customize_nodes, this, std::cref(graph), nodes + t * chunk,
+                                     min(chunk, count - t * chunk), std::ref(this->scratch[t]));
+            }
+            this->customize_nodes(graph, nodes, min(chunk, count), this->scratch[0]);
+            for (auto& worker : workers)
+                worker.join();
+        }
+    }
+    this->base_changed.assign(this->base_changed.size(), 0);
+    this->changed_edges.clear();
+    this->sweep_needed = false;
+    this->customized = true;
+}
+
+/**
+ * @brief Sizes the query state for n nodes.
+ */
+void ContractionHierarchy::allocate_queries(int n) {
+    for (int d = 0; d < 2; d++) {
+        this->dist[d].assign(n, numeric_limits<double>::infinity());
+        this->parent[d].assign(n, -1);
+        this->parent_arc[d].assign(n, -1);
+        this->touched[d].clear();
+    }
+}
+
+/**
+ * @brief Drops the hierarchy, e.g. after the graph changed.
+ */
+void ContractionHierarchy::clear() {
+    this->offsets.clear();
+    this->arcs.clear();
+    this->customizable = false;
+}
+
+/**
+ * @brief Index of the upward arc from -> to, or -1 if there is none.
+ */
+int ContractionHierarchy::find_arc(int from, int to) const {
+    for (unsigned int e = this->offsets[from]; e < this->offsets[from + 1]; e++) {
+        if (this->arcs[e].to == to)
+            return e;
+    }
+    return -1;
+}
+
+/**
+ * @brief Appends the nodes of an arc, with its shortcuts expanded, to nodes.
+ * A shortcut x - y bypassing m is made of the arcs m - x and m - y, both stored at m, so
+ * half of every expansion is walked against the direction it is stored in.
+ * @param from The node whose row holds the arc; it is not appended itself.
+ * @param arc The index of the arc, walked from from to arcs[arc].to.
+ * @param nodes Receives the nodes after from, ending with arcs[arc].to.
+ */
+void ContractionHierarchy::unpack(int from, int arc, vector<int>& nodes) const {
+    struct Step{
+        int owner;
+        int arc;
+        bool reversed; // walked from arcs[arc].to to owner
+    };
+    vector<Step> stack{Step{from, arc, false}};
+    while (!stack.empty()) {
+        Step step = stack.back();
+        stack.pop_back();
+        const Arc& current = this->arcs[step.arc];
+        if (current.middle < 0) {
+            nodes.push_back(step.reversed ? step.owner : current.to);
+            continue;
+        }
+        // the half pushed last is walked first
+        int to_owner = this->find_arc(current.middle, step.owner);
+        int to_target = this->find_arc(current.middle, current.to);
+        if (!step.reversed) {
+            stack.push_back(Step{current.middle, to_target, false});
+            stack.push_back(Step{current.middle, to_owner, true});
+        } else {
+            stack.push_back(Step{current.middle, to_owner, false});
+            stack.push_back(Step{current.middle, to_target, true});
+        }
+    }
+}
+
+/**
+ * @brief Bidirectional upward Dijkstra. Each side stops once its queue holds nothing
+ * shorter than the best connection found so far.
+ * @param source The dense index of the source node.
+ * @param dest The dense index of the destination node.
+ * @param path If not nullptr, receives the dense nodes of the path, source first.
+ * @param settled Receives the number of nodes settled by both sides.
+ * @return The cost of the shortest path, infinity if dest cannot be reached.
+ */
+double ContractionHierarchy::query(int source, int dest, vector<int>* path, unsigned int& settled) {
+    typedef pair<double, int> QueueEntry;
+    priority_queue<QueueEntry, vector<QueueEntry>, greater<QueueEntry>> queue[2];
+    const int start[2] = {source, dest};
+    for (int d = 0; d < 2; d++) {
+        for (int v : this->touched[d])
+            this->dist[d][v] = numeric_limits<double>::infinity();
+        this->touched[d].clear();
+        this->dist[d][start[d]] = 0;
+        this->parent[d][start[d]] = -1;
+        this->touched[d].push_back(start[d]);
+        queue[d].push({0, start[d]});
+    }
+
+    double best = numeric_limits<double>::infinity();
+    int meet = -1;
+    settled = 0;
+    while (true) {
+        int d = -1;
+        for (int side = 0; side < 2; side++) {
+            if (!queue[side].empty() && queue[side].top().first < best
+                && (d == -1 || queue[side].top().first < queue[d].top().first))
+                d = side;
+        }
+        if (d == -1)
+            break;
+
+        double current_dist = queue[d].top().first;
+        int u = queue[d].top().second;
+        queue[d].pop();
+        if (current_dist > this->dist[d][u])
+            continue;
+        settled++;
+        if (current_dist + this->dist[1 - d][u] < best) {
+            best = current_dist + this->dist[1 - d][u];
+            meet = u;
+        }
+
+        for (unsigned int e = this->offsets[u]; e < this->offsets[u + 1]; e++) {
+            int v = this->arcs[e].to;
+            if (current_dist + this->arcs[e].weight < this->dist[d][v]) {
+                if (this->dist[d][v] == numeric_limits<double>::infinity())
+                    this->touched[d].push_back(v);
+                this->dist[d][v] = current_dist + this->arcs[e].weight;
+                this->parent[d][v] = u;
+                this->parent_arc[d][v] = e;
+                queue[d].push({this->dist[d][v], v});
+            }
+        }
+    }
+
+    if (path != nullptr) {
+        path->clear();
+        if (meet != -1) {
+            // both halves are unpacked upwards, the destination half is then reversed
+            vector<int> half[2];
+            for (int d = 0; d < 2; d++) {
+                vector<int> chain;
+                for (int v = meet; v != start[d]; v = this->parent[d][v])
+                    chain.push_back(v);
+                half[d].push_back(start[d]);
+                for (auto it = chain.rbegin(); it != chain.rend(); ++it)
+                    this->unpack(this->parent[d][*it], this->parent_arc[d][*it], half[d]);
+            }
+            *path = half[0];
+            path->insert(path->end(), half[1].rbegin() + 1, half[1].rend());
+        }
+    }
+    return best;
+}
+
 void Graph::insert(int a, int b, double d, double s, bool silence){
+    const bool existed = this->edge_exists(a, b);
+    const double old_weight = existed ? g[a][b].d / (g[a][b].s * g[a][b].a) : 0;
     g[a][b].d = d;
     g[a][b].s = s;
 
     g[b][a].d = d;
     g[b][a].s = s;
 
+    bool forward = this->compiled.update_edge(a, b, g[a][b].d / (g[a][b].s * g[a][b].a));
+    bool backward = this->compiled.update_edge(b, a, g[b][a].d / (g[b][a].s * g[b][a].a));
+    this->weights_changed(forward && backward, !existed || g[a][b].d / (g[a][b].s * g[a][b].a) < old_weight, a, b);
+
     if (!silence)
         cout << "success" << endl;
 }
@@ -29,9 +1004,15 @@ void Graph::delete_n(int a) {
     if (this->node_exists(a)) {
         // delete the vertex a and any edges containing a
         for (auto i : g[a]) {
-            g[i.first].erase(a);
+            // a self-loop is erased with g[a] below, erasing it here would invalidate i
+            if (i.first != a)
+                g[i.first].erase(a);
+            this->compiled.touch(i.first);
         }
         g.erase(a);
+        this->compiled.touch(a);
+        this->ch.clear();
+        this->num_landmarks = 0;
 
         cout << "success" << endl;
         return;
@@ -46,8 +1027,12 @@ void Graph::traffic(int a, int b, double aprime, bool silence) {
         return;
     }
 
+    const bool decreased = aprime > g[a][b].a;
     g[a][b].a = aprime;
     g[b][a].a = aprime;
+    bool forward = this->compiled.update_edge(a, b, g[a][b].d / (g[a][b].s * g[a][b].a));
+    bool backward = this->compiled.update_edge(b, a, g[b][a].d / (g[b][a].s * g[b][a].a));
+    this->weights_changed(forward && backward, decreased, a, b);
     if (!silence)
         cout << "success" << endl;
 }
@@ -109,86 +1094,445 @@ void Graph::load(const string& filename) {
     cout << "success" << endl;
 }
 
-void Graph::dijkstra(int source, int dest, unordered_map<int, double>& dist, unordered_map<int, int>& prev) {
+/**
+ * @brief Calls visit(v, weight) for every edge u -> v, reading clean nodes from their CSR
+ * row and dirty ones from the adjacency map.
+ * @param u The dense index of the node.
+ */
+template <typename Visit>
+void Graph::for_each_edge(int u, Visit visit) const {
+    if (!this->compiled.dirty[u]) {
+        for (unsigned int e = this->compiled.offsets[u]; e < this->compiled.offsets[u + 1]; e++)
+            visit(this->compiled.targets[e], this->compiled.weights[e]);
+        return;
+    }
+    auto node = g.find(this->compiled.ids[u]);
+    if (node == g.end())
+        return;
+    for (const auto& edge : node->second)
+        visit(this->compiled.index.find(edge.first)->second, edge.second.d / (edge.second.s * edge.second.a));
+}
+
+/**
+ * @brief Starts a new search over ids.size() dense nodes, growing the arrays if needed.
+ * @param ids The node IDs of the dense nodes, which break ties between equal keys.
+ */
+void SearchWorkspace::reset(const vector<int>& ids) {
+    const unsigned int n = ids.size();
+    if (this->stamp.size() < n) {
+        this->stamp.resize(n, 0);
+        this->dist.resize(n);
+        this->key.resize(n);
+        this->bound.resize(n);
+        this->prev.resize(n);
+        this->position.resize(n);
+    }
+    this->ids = &ids;
+    this->heap.clear();
+    if (++this->generation == 0) {
+        fill(this->stamp.begin(), this->stamp.end(), 0);
+        this->generation = 1;
+    }
+}
+
+/**
+ * @brief Marks v as reached by the current search, initialising its entries on first use.
+ */
+void SearchWorkspace::touch(int v) {
+    if (this->stamp[v] != this->generation) {
+        this->stamp[v] = this->generation;
+        this->dist[v] = numeric_limits<double>::infinity();
+        this->prev[v] = -1;
+        this->position[v] = -1;
+        this->bound[v] = -1;
+    }
+}
+
+/**
+ * @return The distance of v found by the current search, infinity if not reached.
+ */
+double SearchWorkspace::distance(int v) const {
+    return this->stamp[v] == this->generation ? this->dist[v] : numeric_limits<double>::infinity();
+}
+
+/**
+ * @brief Records a path to v through from if it is shorter than the best known, queueing v
+ * with the given key or lowering its key if it is already queued.
+ * @param v The dense node reached.
+ * @param from The previous node on the path, -1 for the source.
+ * @param distance The length of the path.
+ * @param priority The key of v in the queue.
+ * @return True if the path is an improvement.
+ */
+bool SearchWorkspace::relax(int v, int from, double distance, double priority) {
+    this->touch(v);
+    if (!(distance < this->dist[v]))
+        return false;
+    this->dist[v] = distance;
+    this->prev[v] = from;
+    this->key[v] = priority;
+    if (this->position[v] < 0) {
+        this->position[v] = this->heap.size();
+        this->heap.push_back(v);
+    }
+    this->sift_up(this->position[v]);
+    return true;
+}
+
+/**
+ * @brief Removes and returns the queued node with the smallest key.
+ */
+int SearchWorkspace::pop() {
+    int top = this->heap.front();
+    this->position[top] = -1;
+    int last = this->heap.back();
+    this->heap.pop_back();
+    if (!this->heap.empty()) {
+        this->heap[0] = last;
+        this->sift_down(0);
+    }
+    return top;
+}
+
+bool SearchWorkspace::before(int u, int v) const {
+    return this->key[u] < this->key[v] || (this->key[u] == this->key[v] && (*this->ids)[u] < (*this->ids)[v]);
+}
+
+void SearchWorkspace::sift_up(unsigned int i) {
+    int v = this->heap[i];
+    while (i > 0) {
+        unsigned int parent = (i - 1) / ARITY;
+        if (!this->before(v, this->heap[parent]))
+            break;
+        this->heap[i] = this->heap[parent];
+        this->position[this->heap[i]] = i;
+        i = parent;
+    }
+    this->heap[i] = v;
+    this->position[v] = i;
+}
+
+void SearchWorkspace::sift_down(unsigned int i) {
+    const unsigned int n = this->heap.size();
+    int v = this->heap[i];
+    while (true) {
+        unsigned int first = i * ARITY + 1;
+        if (first >= n)
+            break;
+        unsigned int best = first;
+        for (unsigned int c = first + 1; c < min(first + ARITY, n); c++) {
+            if (this->before(this->heap[c], this->heap[best]))
+                best = c;
+        }
+        if (!this->before(this->heap[best], v))
+            break;
+        this->heap[i] = this->heap[best];
+        this->position[this->heap[i]] = i;
+        i = best;
+    }
+    this->heap[i] = v;
+    this->position[v] = i;
+}
+
+namespace {
+
+const unsigned int NUM_LANDMARKS = 8;
+
+/**
+ * @brief Parses the optional search name of a path or lowest command.
+ * @return False if the name is not a search.
+ */
+bool parse_mode(const string& name, QueryMode& mode) {
+    if (name.empty())
+        mode = QueryMode::AUTO;
+    else if (name == "dijkstra")
+        mode = QueryMode::DIJKSTRA;
+    else if (name == "bidir")
+        mode = QueryMode::BIDIRECTIONAL;
+    else if (name == "astar")
+        mode = QueryMode::ASTAR;
+    else
+        return false;
+    return true;
+}
+
+/**
+ * @brief Search state of the calling thread. Bidirectional searches use both sides.
+ */
+SearchWorkspace& workspace(int side) {
+    static thread_local SearchWorkspace workspaces[2];
+    return workspaces[side];
+}
+
+} // namespace
+
+void Graph::dijkstra(int source, int dest, SearchWorkspace& workspace) {
     /**
-     * Implements Dijkstra's algorithm to find the shortest path from a source node to all other nodes in the graph.
+     * Implements Dijkstra's algorithm on the compiled graph, stopping once dest is settled.
      * 
-     * This function updates two maps: `dist` which holds the minimum distance from the source node to every other node,
-     * and `prev` which stores the previous node in the optimal path from the source to a given node.
+     * Nodes are dense indices of this->compiled. A dest of -1 searches the whole graph.
      * 
-     * @param source The source node from which distances are calculated.
-     * @param dist A reference to a map where the key is the node and the value is the minimum distance from the source node.
-     * @param prev A reference to a map where the key is the node and the value is the previous node in the optimal path from the source.
+     * @param source The dense index of the source node.
+     * @param dest The dense index of the destination node.
+     * @param workspace Receives the distance from the source and previous node of every node reached.
      */
-    // Initialize a priority queue to store nodes in ascending order of their distance from the source.
-    priority_queue<pair<double, int>, vector<pair<double, int>>, greater<pair<double, int>>> pq;
-    // Set the initial distance of all nodes to infinity and their previous node to -1.
-    for (auto& node : g) {
-        dist[node.first] = numeric_limits<double>::infinity();
-        prev[node.first] = -1;
-    }
-    // Set the distance of the source node to itself as 0 and push it into the priority queue.
-    dist[source] = 0;
-    pq.push({0, source});
-
-    // Process nodes in the priority queue until it's empty.
-    while (!pq.empty()) {
-        // Extract the node with the smallest distance from the priority queue.
-        double current_dist = pq.top().first;
-        int u = pq.top().second;
-        pq.pop();
-
-        // skip if not less than the shortest path
-        if (current_dist > dist[u]) {
-            continue;
-        }
+    workspace.reset(this->compiled.ids);
+    workspace.relax(source, -1, 0, 0);
+
+    while (!workspace.empty()) {
+        int u = workspace.pop();
+        this->last_settled++;
 
         // stop the algorithm if the destination node is reached
         if (u == dest) {
             break;
         }
 
-        // Iterate through all edges of the current node.
-        for (const auto& edge : g[u]) {
-            int v = edge.first; // The adjacent node
-            // Calculate the weight of the edge using the given formula.
-            double weight = edge.second.d / (edge.second.s * edge.second.a);
-            // If a shorter path to the adjacent node is found, update its distance and previous node.
-            if (dist[u] + weight < dist[v]) {
-                dist[v] = dist[u] + weight;
-                prev[v] = u;
-                // Push the updated distance of the adjacent node into the priority queue.
-                pq.push({dist[v], v});
+        double current_dist = workspace.distance(u);
+        this->for_each_edge(u, [&](int v, double weight) {
+            workspace.relax(v, u, current_dist + weight, current_dist + weight);
+        });
+    }
+}
+
+/**
+ * @brief Dijkstra from source until every marked target is settled. Only reads the graph,
+ * so searches from different sources can run on different threads.
+ * @param source The dense index of the source node.
+ * @param is_target Marks the dense nodes whose distance is needed.
+ * @param num_targets The number of marked nodes.
+ * @param workspace Receives the distance from the source of every node reached.
+ */
+void Graph::one_to_many(int source, const vector<char>& is_target, unsigned int num_targets,
+                        SearchWorkspace& workspace) const {
+    workspace.reset(this->compiled.ids);
+    workspace.relax(source, -1, 0, 0);
+    while (!workspace.empty() && num_targets > 0) {
+        int u = workspace.pop();
+        if (is_target[u])
+            num_targets--;
+
+        double current_dist = workspace.distance(u);
+        this->for_each_edge(u, [&](int v, double weight) {
+            workspace.relax(v, u, current_dist + weight, current_dist + weight);
+        });
+    }
+}
+
+/**
+ * @brief Picks NUM_LANDMARKS landmarks far apart and stores their distances to every node.
+ * Each landmark is the node farthest from those picked so far, the first one the node
+ * farthest from node 0; nodes another landmark cannot reach are not candidates.
+ */
+void Graph::select_landmarks() {
+    const int n = this->compiled.size();
+    this->num_landmarks = min<unsigned int>(NUM_LANDMARKS, n);
+    this->landmarks.assign(this->num_landmarks, 0);
+    this->landmarks_stale = false;
+    this->landmark_dist.assign(static_cast<std::size_t>(n) * this->num_landmarks, numeric_limits<double>::infinity());
+    vector<double> nearest(n, numeric_limits<double>::infinity());
+    SearchWorkspace& search = workspace(0);
+    this->dijkstra(0, -1, search);
+    for (int v = 0; v < n; v++)
+        nearest[v] = search.distance(v);
+    for (unsigned int i = 0; i < this->num_landmarks; i++) {
+        int landmark = 0;
+        for (int v = 0; v < n; v++) {
+            if (nearest[v] != numeric_limits<double>::infinity()
+                && (nearest[landmark] == numeric_limits<double>::infinity() || nearest[v] > nearest[landmark]))
+                landmark = v;
+        }
+        this->landmarks[i] = landmark;
+        this->dijkstra(landmark, -1, search);
+        for (int v = 0; v < n; v++) {
+            double d = search.distance(v);
+            this->landmark_dist[static_cast<std::size_t>(v) * this->num_landmarks + i] = d;
+            if (d != numeric_limits<double>::infinity())
+                nearest[v] = i == 0 ? d : min(nearest[v], d);
+        }
+    }
+}
+
+/**
+ * @brief Measures the distances from the landmarks already picked again, one Dijkstra each,
+ * after an edge weight decreased. The landmarks are still far apart, so they are kept.
+ */
+void Graph::measure_landmarks() {
+    const int n = this->compiled.size();
+    SearchWorkspace& search = workspace(0);
+    for (unsigned int i = 0; i < this->num_landmarks; i++) {
+        this->dijkstra(this->landmarks[i], -1, search);
+        for (int v = 0; v < n; v++)
+            this->landmark_dist[static_cast<std::size_t>(v) * this->num_landmarks + i] = search.distance(v);
+    }
+    this->landmarks_stale = false;
+}
+
+/**
+ * @brief A* search towards dest with the ALT lower bound: by the triangle inequality the
+ * distance from v to dest is at least |d(L, dest) - d(L, v)| for every landmark L.
+ * Landmarks are selected again by the first A* query after the edges changed, and their
+ * distances measured again after a weight decreased.
+ * @param source The dense index of the source node.
+ * @param dest The dense index of the destination node.
+ * @param workspace Receives the distance from the source and previous node of every node reached.
+ */
+void Graph::astar(int source, int dest, SearchWorkspace& workspace) {
+    if (this->num_landmarks == 0) {
+        this->select_landmarks();
+        this->last_settled = 0;
+    } else if (this->landmarks_stale) {
+        this->measure_landmarks();
+        this->last_settled = 0;
+    }
+    const unsigned int k = this->num_landmarks;
+    const double* to_dest = this->landmark_dist.data() + static_cast<std::size_t>(dest) * k;
+    auto heuristic = [&](int v) {
+        double& bound = workspace.scratch(v);
+        if (bound < 0) {
+            const double* to_v = this->landmark_dist.data() + static_cast<std::size_t>(v) * k;
+            bound = 0;
+            for (unsigned int i = 0; i < k; i++) {
+                if (to_v[i] != numeric_limits<double>::infinity() && to_dest[i] != numeric_limits<double>::infinity())
+                    bound = max(bound, fabs(to_dest[i] - to_v[i]));
             }
         }
+        return bound;
+    };
+
+    workspace.reset(this->compiled.ids);
+    workspace.relax(source, -1, 0, heuristic(source));
+    while (!workspace.empty()) {
+        int u = workspace.pop();
+        this->last_settled++;
+        if (u == dest)
+            break;
+
+        double current_dist = workspace.distance(u);
+        this->for_each_edge(u, [&](int v, double weight) {
+            double d = current_dist + weight;
+            if (d < workspace.distance(v))
+                workspace.relax(v, u, d, d + heuristic(v));
+        });
     }
 }
 
-void Graph::path(int a, int b) {
-    if (!this->node_exists(a) || !this->node_exists(b)) {
-        cout << "failure" << endl;
-        return;
+/**
+ * @brief Dijkstra from both ends at once, always advancing the side with the smaller key.
+ * Roads are undirected, so the backward search uses the same edges. The search stops once
+ * the two smallest keys add up to no less than the best connection seen.
+ * @param source The dense index of the source node.
+ * @param dest The dense index of the destination node.
+ * @param path If not nullptr, receives the node IDs along the path, source first.
+ * @return The cost of the path, infinity if dest cannot be reached.
+ */
+double Graph::bidirectional(int source, int dest, vector<int>* path) {
+    SearchWorkspace* search[2] = {&workspace(0), &workspace(1)};
+    const int start[2] = {source, dest};
+    for (int d = 0; d < 2; d++) {
+        search[d]->reset(this->compiled.ids);
+        search[d]->relax(start[d], -1, 0, 0);
     }
 
-    if (a == b) {
+    double best = source == dest ? 0 : numeric_limits<double>::infinity();
+    int meet = source;
+    while (!search[0]->empty() || !search[1]->empty()) {
+        double top[2];
+        for (int d = 0; d < 2; d++)
+            top[d] = search[d]->empty() ? numeric_limits<double>::infinity() : search[d]->top_key();
+        if (top[0] + top[1] >= best)
+            break;
+        const int d = top[0] <= top[1] ? 0 : 1;
+        SearchWorkspace& forward = *search[d];
+        const SearchWorkspace& backward = *search[1 - d];
+        int u = forward.pop();
+        this->last_settled++;
+
+        double current_dist = forward.distance(u);
+        this->for_each_edge(u, [&](int v, double weight) {
+            double dist = current_dist + weight;
+            if (forward.relax(v, u, dist, dist) && dist + backward.distance(v) < best) {
+                best = dist + backward.distance(v);
+                meet = v;
+            }
+        });
+    }
+
+    if (path != nullptr) {
+        path->clear();
+        if (best != numeric_limits<double>::infinity()) {
+            for (int at = meet; at != -1; at = search[0]->previous(at))
+                path->push_back(this->compiled.ids[at]);
+            reverse(path->begin(), path->end());
+            for (int at = search[1]->previous(meet); at != -1; at = search[1]->previous(at))
+                path->push_back(this->compiled.ids[at]);
+        }
+    }
+    return best;
+}
+
+/**
+ * @brief Finds the shortest path between two dense nodes with the given search, and
+ * records the number of nodes it settled.
+ * @param source The dense index of the source node.
+ * @param dest The dense index of the destination node.
+ * @param mode The search to use.
+ * @param path If not nullptr, receives the node IDs along the path, source first.
+ * @return The cost of the path, infinity if dest cannot be reached.
+ */
+double Graph::route(int source, int dest, QueryMode mode, vector<int>* path) {
+    this->last_settled = 0;
+    if (mode == QueryMode::AUTO && this->ch.is_ready()) {
+        if (!this->ch.is_customized())
+            this->ch.customize(this->compiled);
+        double cost = this->ch.query(source, dest, path, this->last_settled);
+        if (path != nullptr) {
+            for (int& v : *path)
+                v = this->compiled.ids[v];
+        }
+        return cost;
+    }
+    if (mode == QueryMode::BIDIRECTIONAL)
+        return this->bidirectional(source, dest, path);
+
+    SearchWorkspace& search = workspace(0);
+    if (mode == QueryMode::ASTAR)
+        this->astar(source, dest, search);
+    else
+        this->dijkstra(source, dest, search);
+    double cost = search.distance(dest);
+    if (path != nullptr) {
+        path->clear();
+        if (cost != numeric_limits<double>::infinity()) {
+            for (int at = dest; at != -1; at = search.previous(at)) {
+                path->push_back(this->compiled.ids[at]);
+            }
+            reverse(path->begin(), path->end());
+        }
+    }
+    return cost;
+}
+
+void Graph::path(int a, int b, const string& mode) {
+    QueryMode query_mode;
+    if (!parse_mode(mode, query_mode) || !this->node_exists(a) || !this->node_exists(b)) {
         cout << "failure" << endl;
         return;
     }
 
-    unordered_map<int, double> dist;
-    unordered_map<int, int> prev;
-    this->dijkstra(a, b, dist, prev);
-
-    if (dist[b] == numeric_limits<double>::infinity()) {
+    if (a == b) {
         cout << "failure" << endl;
         return;
     }
 
+    if (this->compiled.stale)
+        this->compiled.compile(g);
     vector<int> path;
-    for (int at = b; at != -1; at = prev[at]) {
-        path.push_back(at);
+    if (this->route(this->compiled.index[a], this->compiled.index[b], query_mode, &path)
+        == numeric_limits<double>::infinity()) {
+        cout << "failure" << endl;
+        return;
     }
-    reverse(path.begin(), path.end());
 
     if (path.size() == 1 && path[0] == a) {
         cout << "failure" << endl;
@@ -201,22 +1545,151 @@ void Graph::path(int a, int b) {
     cout << endl;
 }
 
-void Graph::lowest(int a, int b) {
-    if (!this->node_exists(a) || !this->node_exists(b)) {
+void Graph::lowest(int a, int b, const string& mode) {
+    QueryMode query_mode;
+    if (!parse_mode(mode, query_mode) || !this->node_exists(a) || !this->node_exists(b)) {
         cout << "failure" << endl;
         return;
     }
 
-    unordered_map<int, double> dist;
-    unordered_map<int, int> prev;
-    this->dijkstra(a, b, dist, prev);
+    if (this->compiled.stale)
+        this->compiled.compile(g);
+    double cost = this->route(this->compiled.index[a], this->compiled.index[b], query_mode, nullptr);
 
-    if (dist[b] == numeric_limits<double>::infinity()) {
+    if (cost == numeric_limits<double>::infinity()) {
         cout << "failure" << endl;
     } else {
     //after getting the lowest_cost  you can use the following code to round-off the lowest_cost before printing .
         std::cout << std::fixed << std::showpoint;
         std::cout << std::setprecision(3);
-        cout << dist[b] << endl;
+        cout << cost << endl;
     }
 }
+
+/**
+ * @brief Prints the number of nodes settled by the last path or lowest search.
+ */
+void Graph::settled() {
+    cout << this->last_settled << endl;
+}
+
+/**
+ * @brief Reads whitespace-separated node IDs from a file.
+ * @return False if the file cannot be read or names a node not in the graph.
+ */
+bool Graph::read_nodes(const string& filename, vector<int>& nodes) {
+    ifstream file{filename};
+    if (!file)
+        return false;
+    nodes.clear();
+    int id;
+    while (file >> id) {
+        if (!this->node_exists(id))
+            return false;
+        nodes.push_back(id);
+    }
+    return file.eof();
+}
+
+/**
+ * @brief Writes the lowest cost from every node listed in sources_file to every node listed in
+ * targets_file. Each source runs one Dijkstra that stops once all targets are settled, and the
+ * sources are shared out between a pool of threads. Each thread searches in its own workspace,
+ * which later calls reuse rather than allocating O(V) state again.
+ * 
+ * An output_file ending in .bin receives the row and column counts as 32-bit integers, the
+ * source IDs, the target IDs and then the costs as row-major doubles. Any other name receives a
+ * CSV with the target IDs in the header row and the source ID first on each row. Unreachable
+ * pairs are written as infinity (inf in the CSV).
+ * @param sources_file File listing the source node IDs.
+ * @param targets_file File listing the target node IDs.
+ * @param output_file The file to write the matrix to.
+ */
+void Graph::matrix(const string& sources_file, const string& targets_file, const string& output_file) {
+    vector<int> sources, targets;
+    if (!this->read_nodes(sources_file, sources) || !this->read_nodes(targets_file, targets) || output_file.empty()) {
+        cout << "failure" << endl;
+        return;
+    }
+    if (this->compiled.stale)
+        this->compiled.compile(g);
+
+    vector<char> is_target(this->compiled.size(), 0);
+    unsigned int num_targets = 0;
+    vector<int> target_index(targets.size());
+    for (unsigned int j = 0; j < targets.size(); j++) {
+        target_index[j] = this->compiled.index[targets[j]];
+        if (!is_target[target_index[j]]) {
+            is_target[target_index[j]] = 1;
+            num_targets++;
+        }
+    }
+    vector<int> source_index(sources.size());
+    for (unsigned int i = 0; i < sources.size(); i++)
+        source_index[i] = this->compiled.index[sources[i]];
+
+    vector<double> costs(sources.size() * targets.size());
+    atomic<unsigned int> next_source(0);
+    unsigned int num_threads = max(1u, min<unsigned int>(thread::hardware_concurrency(), sources.size()));
+    if (this->matrix_workspaces.size() < num_threads)
+        this->matrix_workspaces.resize(num_threads);
+    auto work = [&](unsigned int t) {
+        SearchWorkspace& search = this->matrix_workspaces[t];
+        for (unsigned int i = next_source++; i < sources.size(); i = next_source++) {
+            this->one_to_many(source_index[i], is_target, num_targets, search);
+            for (unsigned int j = 0; j < targets.size(); j++)
+                costs[i * targets.size() + j] = search.distance(target_index[j]);
+        }
+    };
+    vector<thread> workers;
+    for (unsigned int t = 1; t < num_threads; t++)
+        workers.emplace_back(work, t);
+    work(0);
+    for (auto& worker : workers)
+        worker.join();
+
+    const bool binary = output_file.size() >= 4 && output_file.compare(output_file.size() - 4, 4, ".bin") == 0;
+    ofstream file{output_file, binary ? ios::binary : ios::out};
+    if (!file) {
+        cout << "failure" << endl;
+        return;
+    }
+    if (binary) {
+        const uint32_t rows = sources.size(), cols = targets.size();
+        file.write(reinterpret_cast<const char*>(&rows), sizeof(rows));
+        file.write(reinterpret_cast<const char*>(&cols), sizeof(cols));
+        file.write(reinterpret_cast<const char*>(sources.data()), sources.size() * sizeof(int));
+        file.write(reinterpret_cast<const char*>(targets.data()), targets.size() * sizeof(int));
+        file.write(reinterpret_cast<const char*>(costs.data()), costs.size() * sizeof(double));
+    } else {
+        file << std::fixed << std::setprecision(3);
+        for (int target : targets)
+            file << ',' << target;
+        file << '\n';
+        for (unsigned int i = 0; i < sources.size(); i++) {
+            file << sources[i];
+            for (unsigned int j = 0; j < targets.size(); j++)
+                file << ',' << costs[i * targets.size() + j];
+            file << '\n';
+        }
+    }
+    cout << (file ? "success" : "failure") << endl;
+}
+
+/**
+ * @brief Builds a contraction hierarchy that path and lowest use until the graph changes.
+ * With mode "cch" the hierarchy is customizable and survives traffic changes and inserts
+ * over existing edges; other inserts and deletes drop it. Otherwise any change drops it.
+ * @param mode "cch" for a customizable hierarchy, anything else for a plain one.
+ */
+void Graph::preprocess(const string& mode) {
+    this->compiled.compile(g);
+    this->num_landmarks = 0;
+    if (mode == "cch") {
+        this->ch.build_customizable(this->compiled);
+        this->ch.customize(this->compiled);
+    } else {
+        this->ch.build(this->compiled);
+    }
+    cout << "success" << endl;
+}
@@ -1,6 +1,8 @@
 #pragma once
 #include <iostream>
 #include <unordered_map>
+#include <vector>
+#include <string>
 
 using namespace std;
 
@@ -22,12 +24,176 @@ struct Edge{
     }
 };
 
+/**
+ * @brief Read-optimized copy of the adjacency map used by path searches.
+ * 
+ * Node IDs are remapped to dense indices and the edges of node u are stored in
+ * targets[offsets[u]] .. targets[offsets[u + 1] - 1], with the travel time d / (s * a) of
+ * each edge in the parallel weights array. Mutations made after compile() form a delta:
+ * weight changes of compiled edges are patched in place, and nodes whose edge set changed
+ * are marked dirty and searched through the adjacency map instead. Once the delta grows
+ * past an eighth of the nodes the whole copy is marked stale and rebuilt by the next search.
+ */
+class CompiledGraph{
+public:
+    std::vector<int> ids; // dense index -> node ID
+    std::unordered_map<int, int> index; // node ID -> dense index
+    std::vector<unsigned int> offsets;
+    std::vector<int> targets;
+    std::vector<double> weights;
+    std::vector<char> dirty; // the CSR row of the node is out of date
+    unsigned int num_dirty = 0;
+    bool stale = true;
+
+    void compile(const std::unordered_map<int, std::unordered_map<int, Edge>>& g);
+    void touch(int a);
+    bool update_edge(int a, int b, double weight);
+    unsigned int size() const { return this->ids.size(); }
+};
+
+/**
+ * @brief Reusable state of one search over the dense nodes of a CompiledGraph.
+ * 
+ * An entry is only valid while its stamp equals the current generation, so reset() starts a
+ * new search in O(1) and a search costs in proportion to the nodes it touches rather than the
+ * size of the graph. The queue is an indexed 4-ary heap with decrease-key, ordered by key and
+ * then by node ID like the lazy queue it replaces.
+ */
+class SearchWorkspace{
+private:
+    static const unsigned int ARITY = 4;
+    std::vector<unsigned int> stamp;
+    std::vector<double> dist;
+    std::vector<double> key;
+    std::vector<double> bound; // per-search scratch value of A*, -1 until set
+    std::vector<int> prev;
+    std::vector<int> position; // index in heap, -1 if not queued
+    std::vector<int> heap;
+    const std::vector<int>* ids = nullptr;
+    unsigned int generation = 0;
+
+    bool before(int u, int v) const;
+    void sift_up(unsigned int i);
+    void sift_down(unsigned int i);
+public:
+    void reset(const std::vector<int>& ids);
+    void touch(int v);
+    bool relax(int v, int from, double distance, double priority);
+    int pop();
+    bool empty() const { return this->heap.empty(); }
+    double top_key() const { return this->key[this->heap.front()]; }
+    double distance(int v) const;
+    int previous(int v) const { return this->stamp[v] == this->generation ? this->prev[v] : -1; }
+    double& scratch(int v) { this->touch(v); return this->bound[v]; }
+};
+
+/**
+ * @brief Contraction hierarchy over the dense nodes of a CompiledGraph.
+ * 
+ * Nodes are contracted one at a time, cheapest edge difference first. Contracting v adds a
+ * shortcut u - w for each pair of its remaining neighbours unless a bounded witness search
+ * finds a path from u to w around v that is no longer. Every edge and shortcut is then kept
+ * only at its lower-ranked end, so both halves of a bidirectional query search upwards.
+ * 
+ * A customizable hierarchy (build_customizable) instead contracts in nested dissection order
+ * and keeps every fill-in arc, so its arcs do not depend on the weights. A change of traffic
+ * then only needs customize() to recompute the arc weights it affects. A few changed edges
+ * are followed arc by arc; larger batches sweep the levels of the hierarchy, splitting wide
+ * levels by node and the expensive separator nodes of narrow levels by lower neighbour
+ * between threads.
+ */
+class ContractionHierarchy{
+private:
+    struct Arc{
+        int to;
+        double weight;
+        int middle; // the node a shortcut bypasses, -1 for a road
+    };
+
+    std::vector<unsigned int> offsets; // upward arcs of u are arcs[offsets[u]] .. arcs[offsets[u + 1] - 1]
+    std::vector<Arc> arcs;
+
+    // customizable hierarchies only
+    bool customizable = false;
+    bool customized = false;
+    std::vector<int> arc_edge; // index of the compiled edge behind an arc, -1 for a pure shortcut
+    std::vector<unsigned int> down_offsets; // arcs into v from below are down[down_offsets[v]] .. down[down_offsets[v + 1] - 1]
+    std::vector<std::pair<int, int>> down; // (lower node, arc index)
+    std::vector<int> by_level; // nodes ordered by level, a node's lower neighbours all sit on lower levels
+    std::vector<unsigned int> level_offsets;
+    std::vector<int> rank; // position of each node in the contraction order
+    std::vector<char> base_changed; // an edge behind one of the node's arcs has a new weight
+    std::vector<char> arcs_changed; // the last customize() changed one of the node's arc weights
+    std::vector<std::pair<int, int>> changed_edges; // dense ends of the edges changed since customize()
+    bool sweep_needed = false; // never customized, or too many changes to follow arc by arc
+    std::vector<char> arc_queued;
+    struct Scratch{
+        std::vector<int> slot; // position among the current node's arcs of its arc to each node, -1 for none
+        std::vector<double> old_weights;
+        std::vector<Arc> candidates; // best triangle this thread found for each arc of the current node
+    };
+    std::vector<Scratch> scratch; // one per customize() thread
+
+    // query state, reset through the touched lists so a query costs what it visits
+    std::vector<double> dist[2];
+    std::vector<int> parent_arc[2]; // arc that reached the node, -1 at the search start
+    std::vector<int> parent[2];
+    std::vector<int> touched[2];
+
+    int find_arc(int from, int to) const;
+    void unpack(int from, int arc, std::vector<int>& nodes) const;
+    void allocate_queries(int n);
+    int arc_between(int a, int b) const;
+    bool begin_node(const CompiledGraph& graph, int v, Scratch& scratch);
+    void lower_triangles(int v, unsigned int first, unsigned int last, const std::vector<int>& slot, Arc* out) const;
+    void end_node(int v, Scratch& scratch);
+    void customize_nodes(const CompiledGraph& graph, const int* nodes, unsigned int count, Scratch& scratch);
+    void customize_split(const CompiledGraph& graph, int v, unsigned int num_threads);
+    void customize_arcs(const CompiledGraph& graph);
+
+public:
+    void build(const CompiledGraph& graph);
+    void build_customizable(const CompiledGraph& graph);
+    void customize(const CompiledGraph& graph);
+    void clear();
+    bool is_ready() const { return !this->offsets.empty(); }
+    bool is_customizable() const { return this->customizable; }
+    bool is_customized() const { return this->customized; }
+    void weights_changed(int a, int b);
+    double query(int source, int dest, std::vector<int>* path, unsigned int& settled);
+};
+
+/**
+ * @brief Search used by a path or lowest query. AUTO is the contraction hierarchy once
+ * preprocess has built one and DIJKSTRA otherwise.
+ */
+enum class QueryMode { AUTO, DIJKSTRA, BIDIRECTIONAL, ASTAR };
+
 class Graph{
 private:
     std::unordered_map<int, std::unordered_map<int, Edge>> g;
+    CompiledGraph compiled;
+    ContractionHierarchy ch;
+    std::vector<int> landmarks;
+    std::vector<double> landmark_dist; // distance between landmark i and node v at [v * num_landmarks + i]
+    unsigned int num_landmarks = 0; // 0 until the first A* query after the nodes or edges changed
+    bool landmarks_stale = false; // an edge weight decreased since landmark_dist was computed
+    unsigned int last_settled = 0;
+    std::vector<SearchWorkspace> matrix_workspaces; // one per matrix() thread, kept across calls
     bool edge_exists(int a, int b);
     bool node_exists(int a);
-    void dijkstra(int source, int dest, unordered_map<int, double>& dist, unordered_map<int, int>& prev);
+    bool read_nodes(const string& filename, vector<int>& nodes);
+    template <typename Visit>
+    void for_each_edge(int u, Visit visit) const;
+    void dijkstra(int source, int dest, SearchWorkspace& workspace);
+    void astar(int source, int dest, SearchWorkspace& workspace);
+    double bidirectional(int source, int dest, vector<int>* path);
+    void one_to_many(int source, const std::vector<char>& is_target, unsigned int num_targets,
+                     SearchWorkspace& workspace) const;
+    void select_landmarks();
+    void measure_landmarks();
+    double route(int source, int dest, QueryMode mode, vector<int>* path);
+    void weights_changed(bool in_place, bool decreased, int a, int b);
 
 
 public:
@@ -37,6 +203,9 @@ public:
     void update(const string& filename);
     void print(int a);
     void delete_n(int a);
-    void path(int a, int b);
-    void lowest(int a, int b);
+    void path(int a, int b, const string& mode = "");
+    void lowest(int a, int b, const string& mode = "");
+    void settled();
+    void matrix(const string& sources_file, const string& targets_file, const string& output_file);
+    void preprocess(const string& mode);
 };
\ No newline at end of file